@@ -0,0 +1,148 @@
+#!/usr/bin/python
+#
+# bench-csim.py - Measures how fast ./csim simulates, in references per
+#     second, on the traces in traces/ and on a large synthetic trace.
+#     With -b, the same runs are timed for a second simulator (an older
+#     build of csim, or ./csim-ref) and its results are checked against
+#     ./csim's. If ./traceconv is built, the synthetic trace is also
+#     timed in its delta-encoded binary form.
+#
+#     linux> ./bench-csim.py -g 2G -b ./csim-old
+#
+import subprocess;
+import re;
+import os;
+import sys;
+import time;
+import random;
+import optparse;
+
+# Cache geometries to time: (s, E, b)
+configs = [(5, 1, 5), (4, 4, 4), (10, 16, 6)]
+
+#
+# parseSize - "512M" or "2G" to a number of bytes
+#
+def parseSize(text):
+    units = {'K': 1 << 10, 'M': 1 << 20, 'G': 1 << 30}
+    if text[-1].upper() in units:
+        return int(text[:-1]) * units[text[-1].upper()]
+    return int(text)
+
+#
+# makeTrace - write a synthetic lackey-format trace of about size bytes:
+#     a mix of strided sweeps and random references over a working set,
+#     with one block of records repeated to keep generation quick
+#
+def makeTrace(path, size, seed):
+    rng = random.Random(seed)
+    lines = []
+    base = 0x7ff000000
+    for i in range(1 << 16):
+        r = rng.random()
+        if r < 0.5:
+            addr = base + (i * 8) % (1 << 22)
+        else:
+            addr = base + rng.randrange(1 << 26)
+        op = 'L' if r < 0.8 else ('S' if r < 0.95 else 'M')
+        lines.append(" %s %x,%d\n" % (op, addr, rng.choice([1, 4, 8])))
+    block = "".join(lines)
+    written = 0
+    with open(path, "w") as f:
+        while written < size:
+            f.write(block)
+            written += len(block)
+    return written
+
+#
+# countRefs - number of data references (L, S, M records) in a trace
+#
+def countRefs(path):
+    n = 0
+    with open(path, "rb") as f:
+        while True:
+            chunk = f.read(1 << 24)
+            if not chunk:
+                break
+            n += chunk.count(b"\n") - chunk.count(b"I ")
+    return n
+
+#
+# runSim - time one simulator run, returning (seconds, summary) or
+#     (None, None) if it did not finish within the timeout
+#
+def runSim(sim, config, trace, timeout):
+    args = [sim, "-s", str(config[0]), "-E", str(config[1]),
+            "-b", str(config[2]), "-t", trace]
+    start = time.time()
+    try:
+        out = subprocess.run(args, stdout=subprocess.PIPE,
+                             timeout=timeout).stdout.decode('utf-8')
+    except subprocess.TimeoutExpired:
+        return (None, None)
+    elapsed = time.time() - start
+    m = re.search(r"hits:(\d+) misses:(\d+) evictions:(\d+)", out)
+    return (elapsed, m.groups() if m else None)
+
+#
+# main - Main function
+#
+def main():
+    p = optparse.OptionParser()
+    p.add_option("-b", dest="baseline", help="simulator to compare against")
+    p.add_option("-g", dest="size", default="256M",
+                 help="size of the synthetic trace (default 256M)")
+    p.add_option("-T", dest="timeout", type="float", default=120,
+                 help="seconds before a run is abandoned (default 120)")
+    p.add_option("-s", dest="seed", type="int", default=213,
+                 help="seed for the synthetic trace")
+    opts, args = p.parse_args()
+
+    traces = sorted("traces/" + f for f in os.listdir("traces")
+                    if f.endswith(".trace"))
+    synth = "/tmp/bench-csim-%d.trace" % os.getpid()
+    print("Writing %s synthetic trace %s" % (opts.size, synth))
+    makeTrace(synth, parseSize(opts.size), opts.seed)
+    traces.append(synth)
+    if os.path.exists("./traceconv"):
+        subprocess.run(["./traceconv", "-d", synth, synth + ".bin"],
+                       stdout=subprocess.DEVNULL, check=True)
+        traces.append(synth + ".bin")
+
+    sims = ["./csim"] + ([opts.baseline] if opts.baseline else [])
+    print("%-28s %-10s" % ("trace", "s,E,b") +
+          "".join("%22s" % os.path.basename(sim) for sim in sims))
+    status = 0
+    try:
+        for trace in traces:
+            if not trace.endswith(".bin"):
+                refs = countRefs(trace)
+            for config in configs:
+                row = "%-28s %-10s" % (os.path.basename(trace)[:28],
+                                       "%d,%d,%d" % config)
+                results = []
+                for sim in sims:
+                    if trace.endswith(".bin") and sim != "./csim":
+                        row += "%22s" % "-"
+                        continue
+                    elapsed, summary = runSim(sim, config, trace, opts.timeout)
+                    results.append(summary)
+                    if elapsed is None:
+                        row += "%22s" % ("> %ds" % opts.timeout)
+                    else:
+                        row += "%10.3fs %7.1fM/s" % (elapsed,
+                            refs / max(elapsed, 1e-6) / 1e6)
+                if None not in results and len(set(results)) > 1:
+                    row += "  MISMATCH"
+                    status = 1
+                print(row)
+                sys.stdout.flush()
+    finally:
+        for path in (synth, synth + ".bin"):
+            if os.path.exists(path):
+                os.remove(path)
+    sys.exit(status)
+
+# execute main only if called as a script
+if __name__ == "__main__":
+    main()
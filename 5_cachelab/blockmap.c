@@ -0,0 +1,119 @@
+/**
+ * blockmap.c - A hash map from block addresses to counters
+ *
+ * Open addressing with linear probing over two parallel arrays; the
+ * table doubles when it is half full. Keys are hashed by Fibonacci
+ * multiplication, which spreads the strided block addresses of typical
+ * traces well. There is no removal.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include "blockmap.h"
+
+#define INITIAL_CAPACITY 1024
+
+/**
+ * Allocate a table of the given capacity, all slots free
+ */
+static int allocTable(BlockMap* m, size_t capacity) {
+    if ((m->keys = malloc(capacity * sizeof(unsigned long))) == NULL) {
+        return -1;
+    }
+    if ((m->values = malloc(capacity * sizeof(unsigned long))) == NULL) {
+        free(m->keys);
+        return -1;
+    }
+    memset(m->keys, 0xff, capacity * sizeof(unsigned long));
+    m->mask = capacity - 1;
+    return 0;
+}
+
+/**
+ * Create an empty map
+ * @return 0, or -1 if out of memory
+ */
+int blockMapInit(BlockMap* m) {
+    m->count = 0;
+    return allocTable(m, INITIAL_CAPACITY);
+}
+
+/**
+ * Free a map's storage
+ */
+void blockMapFree(BlockMap* m) {
+    free(m->keys);
+    free(m->values);
+    m->keys = m->values = NULL;
+}
+
+/**
+ * The slot holding key, or the free slot where it belongs
+ */
+static size_t findSlot(const BlockMap* m, unsigned long key) {
+    size_t i = ((key * 0x9e3779b97f4a7c15UL) >> 20) & m->mask;
+
+    while (m->keys[i] != key && m->keys[i] != BLOCKMAP_EMPTY) {
+        i = (i + 1) & m->mask;
+    }
+    return i;
+}
+
+/**
+ * Double the capacity, rehashing every key
+ */
+static int grow(BlockMap* m) {
+    BlockMap old = *m;
+
+    if (allocTable(m, 2 * (old.mask + 1)) < 0) {
+        *m = old;
+        return -1;
+    }
+    for (size_t i = 0; i <= old.mask; i++) {
+        if (old.keys[i] != BLOCKMAP_EMPTY) {
+            size_t j = findSlot(m, old.keys[i]);
+            m->keys[j] = old.keys[i];
+            m->values[j] = old.values[i];
+        }
+    }
+    blockMapFree(&old);
+    return 0;
+}
+
+/**
+ * Find the value of a key without adding it
+ * @return the value's address (valid until a call adds a key), or NULL
+ *     if the key is absent
+ */
+unsigned long* blockMapFind(const BlockMap* m, unsigned long key) {
+    size_t i = findSlot(m, key);
+
+    return m->keys[i] == key ? &m->values[i] : NULL;
+}
+
+/**
+ * Find the value of a key, adding the key with value 0 if it is new
+ * @param key any value except BLOCKMAP_EMPTY
+ * @param isNew if not NULL, set to whether the key was added
+ * @return the value's address (valid until a call adds a key), or NULL
+ *     if out of memory
+ */
+unsigned long* blockMapGet(BlockMap* m, unsigned long key, int* isNew) {
+    size_t i = findSlot(m, key);
+
+    if (isNew != NULL) {
+        *isNew = m->keys[i] == BLOCKMAP_EMPTY;
+    }
+    if (m->keys[i] == BLOCKMAP_EMPTY) {
+        if (2 * (m->count + 1) > m->mask + 1) {
+            if (grow(m) < 0) {
+                return NULL;
+            }
+            i = findSlot(m, key);
+        }
+        m->keys[i] = key;
+        m->values[i] = 0;
+        m->count++;
+    }
+    return &m->values[i];
+}
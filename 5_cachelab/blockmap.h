@@ -0,0 +1,25 @@
+/**
+ * blockmap.h - A hash map from block addresses to counters, for the
+ * cache tools that remember something about every block they have seen
+ */
+
+#ifndef BLOCKMAP_H
+#define BLOCKMAP_H
+
+#include <stddef.h>
+
+#define BLOCKMAP_EMPTY (~0UL)  // reserved key marking a free slot
+
+typedef struct {
+    unsigned long* keys;
+    unsigned long* values;
+    size_t mask;   // capacity - 1, capacity a power of two
+    size_t count;  // keys stored
+} BlockMap;
+
+int blockMapInit(BlockMap* m);
+void blockMapFree(BlockMap* m);
+unsigned long* blockMapGet(BlockMap* m, unsigned long key, int* isNew);
+unsigned long* blockMapFind(const BlockMap* m, unsigned long key);
+
+#endif /* BLOCKMAP_H */
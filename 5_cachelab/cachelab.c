@@ -3,6 +3,7 @@
  */
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <assert.h>
 #include "cachelab.h"
 #include <time.h>
@@ -65,7 +66,101 @@ void correctTrans(int M, int N, int A[N][M], int B[M][N])
     }    
 }
 
+/* 
+ * correctTransElems - baseline transpose of elements of size bytes
+ */
+void correctTransElems(int M, int N, int size, const void* A, void* B)
+{
+    int i, j;
+    for (i = 0; i < N; i++){
+        for (j = 0; j < M; j++){
+            memcpy((char*)B + ((size_t)j * N + i) * size,
+                   (const char*)A + ((size_t)i * M + j) * size, size);
+        }
+    }
+}
+
+
+/* 
+ * initKernel - Initialize the operands of a kernel, with values small
+ *     enough that no sum of products overflows
+ */
+void initKernel(int M, int N, int A[N][M], int B[M][N], int C[N][N])
+{
+    int i, j;
+    srand(time(NULL));
+    for (i = 0; i < N; i++){
+        for (j = 0; j < M; j++){
+            A[i][j]=rand() % 16;
+            B[j][i]=rand() % 16;
+        }
+        for (j = 0; j < N; j++){
+            C[i][j]=rand();
+        }
+    }
+}
+
+/* 
+ * correctMatmul - baseline matrix multiply, C = A B
+ */
+void correctMatmul(int M, int N, int A[N][M], int B[M][N], int C[N][N])
+{
+    int i, j, k, sum;
+    for (i = 0; i < N; i++){
+        for (j = 0; j < N; j++){
+            sum = 0;
+            for (k = 0; k < M; k++){
+                sum += A[i][k] * B[k][j];
+            }
+            C[i][j] = sum;
+        }
+    }
+}
+
+/* 
+ * correctStencil - baseline 5-point stencil of A, N rows of M, written
+ *     to B's memory in the same shape: each point plus its neighbours,
+ *     or the point alone on the border
+ */
+void correctStencil(int M, int N, int A[N][M], int B[M][N], int C[N][N])
+{
+    int (*out)[M] = (int (*)[M])B;
+    int i, j;
+    for (i = 0; i < N; i++){
+        for (j = 0; j < M; j++){
+            if (i == 0 || j == 0 || i == N - 1 || j == M - 1)
+                out[i][j] = A[i][j];
+            else
+                out[i][j] = A[i][j] + A[i-1][j] + A[i+1][j] +
+                            A[i][j-1] + A[i][j+1];
+        }
+    }
+}
 
+/* 
+ * expectKernel - Copy A, B and C to EA, EB and EC, and run function
+ *     fn's baseline on the copies
+ */
+void expectKernel(int fn, int M, int N, const int* A, const int* B,
+                  const int* C, int* EA, int* EB, int* EC)
+{
+    memcpy(EA, A, sizeof(int) * M * N);
+    memcpy(EB, B, sizeof(int) * M * N);
+    memcpy(EC, C, sizeof(int) * N * N);
+    func_list[fn].reference(M, N, (int (*)[M])EA, (int (*)[N])EB,
+                            (int (*)[N])EC);
+}
+
+/* 
+ * sameKernel - Check a kernel's results against expectKernel's
+ */
+int sameKernel(int M, int N, const int* A, const int* B, const int* C,
+               const int* EA, const int* EB, const int* EC)
+{
+    return memcmp(A, EA, sizeof(int) * M * N) == 0 &&
+           memcmp(B, EB, sizeof(int) * M * N) == 0 &&
+           memcmp(C, EC, sizeof(int) * N * N) == 0;
+}
 
 /* 
  * registerTransFunction - Add the given trans function into your list
@@ -75,10 +170,56 @@ void registerTransFunction(void (*trans)(int M, int N, int[N][M], int[M][N]),
                            char* desc)
 {
     func_list[func_counter].func_ptr = trans;
+    func_list[func_counter].kernel_ptr = NULL;
+    func_list[func_counter].reference = NULL;
     func_list[func_counter].description = desc;
+    func_list[func_counter].inplace = 0;
+    func_list[func_counter].elem_size = sizeof(int);
+    func_list[func_counter].elem_typed = 0;
     func_list[func_counter].correct = 0;
     func_list[func_counter].num_hits = 0;
     func_list[func_counter].num_misses = 0;
     func_list[func_counter].num_evictions =0;
     func_counter++;
 }
+
+/* 
+ * registerInplaceFunction - Add an in-place trans function to the list.
+ *     The drivers call it with B pointing at A's memory, so that A^T,
+ *     an M x N matrix, is left where A was.
+ */
+void registerInplaceFunction(void (*trans)(int M, int N, int[N][M], int[M][N]),
+                             char* desc)
+{
+    registerTransFunction(trans, desc);
+    func_list[func_counter - 1].inplace = 1;
+}
+
+/* 
+ * registerElemFunction - Add a trans function for elements of size
+ *     bytes to the list. Its A and B are cast to int matrices to fit the
+ *     list; the drivers fill and check them byte by byte.
+ */
+void registerElemFunction(void (*trans)(int M, int N, int[N][M], int[M][N]),
+                          char* desc, int size)
+{
+    registerTransFunction(trans, desc);
+    func_list[func_counter - 1].elem_size = size;
+    func_list[func_counter - 1].elem_typed = 1;
+}
+
+/* 
+ * registerKernel - Add a kernel other than a transpose to the list. The
+ *     drivers run it on A, B and C, and compare all three with what
+ *     reference leaves in copies of them.
+ */
+void registerKernel(void (*kernel)(int M, int N, int[N][M], int[M][N],
+                                   int[N][N]),
+                    void (*reference)(int M, int N, int[N][M], int[M][N],
+                                      int[N][N]),
+                    char* desc)
+{
+    registerTransFunction(NULL, desc);
+    func_list[func_counter - 1].kernel_ptr = kernel;
+    func_list[func_counter - 1].reference = reference;
+}
@@ -9,7 +9,13 @@
 
 typedef struct trans_func{
     void (*func_ptr)(int M,int N,int[N][M],int[M][N]);
+    /* other kernels have these instead of func_ptr (registerKernel) */
+    void (*kernel_ptr)(int M,int N,int[N][M],int[M][N],int[N][N]);
+    void (*reference)(int M,int N,int[N][M],int[M][N],int[N][N]);
     char* description;
+    char inplace;     /* called with B = A: leaves A^T in A's memory */
+    int elem_size;    /* bytes an element; A and B hold ints if 4 */
+    char elem_typed;  /* registerElemFunction: not ints, even if 4 bytes */
     char correct;
     unsigned int num_hits;
     unsigned int num_misses;
@@ -27,11 +33,47 @@ void printSummary(int hits,  /* number of  hits */
 /* Fill the matrix with data */
 void initMatrix(int M, int N, int A[N][M], int B[M][N]);
 
+/* Fill the matrix with data, without touching B */
+void randMatrix(int M, int N, int A[N][M]);
+
 /* The baseline trans function that produces correct results. */
 void correctTrans(int M, int N, int A[N][M], int B[M][N]);
 
+/* The same, for elements of any size */
+void correctTransElems(int M, int N, int size, const void* A, void* B);
+
+/* Fill the operands of a kernel with small values */
+void initKernel(int M, int N, int A[N][M], int B[M][N], int C[N][N]);
+
+/* Baseline kernels: C = A B, and a 5-point stencil of A into B */
+void correctMatmul(int M, int N, int A[N][M], int B[M][N], int C[N][N]);
+void correctStencil(int M, int N, int A[N][M], int B[M][N], int C[N][N]);
+
+/* Set EA, EB and EC to what function fn's kernel should leave in A, B
+   and C, by running its baseline on copies of them */
+void expectKernel(int fn, int M, int N, const int* A, const int* B,
+                  const int* C, int* EA, int* EB, int* EC);
+
+/* Whether A, B and C are EA, EB and EC */
+int sameKernel(int M, int N, const int* A, const int* B, const int* C,
+               const int* EA, const int* EB, const int* EC);
+
 /* Add the given function to the function list */
 void registerTransFunction(void (*trans)(int M,int N,int[N][M],int[M][N]), 
                            char* desc);
 
+/* Add the given in-place function, which the drivers call with B = A */
+void registerInplaceFunction(void (*trans)(int M,int N,int[N][M],int[M][N]),
+                             char* desc);
+
+/* Add the given function, whose A and B hold elements of size bytes */
+void registerElemFunction(void (*trans)(int M,int N,int[N][M],int[M][N]),
+                          char* desc, int size);
+
+/* Add the given kernel, checked against reference */
+void registerKernel(void (*kernel)(int M,int N,int[N][M],int[M][N],int[N][N]),
+                    void (*reference)(int M,int N,int[N][M],int[M][N],
+                                      int[N][N]),
+                    char* desc);
+
 #endif /* CACHELAB_TOOLS_H */
@@ -0,0 +1,333 @@
+/**
+ * cachemodel.c - A set-associative cache with pluggable replacement
+ *
+ * All state lives in one allocation as parallel arrays: the E tags of a
+ * set are adjacent 64-bit words, their replacement state follows in a
+ * second array, and a bitmap per set records which lines are valid. A
+ * lookup compares the tags of a set 64 at a time into a match mask (a
+ * loop the compiler can vectorize) and masks it with the valid bits; an
+ * empty line for a fill is the first clear valid bit. A second bitmap
+ * marks dirty lines for write-back caches.
+ *
+ * The E replacement words of a set ("stamps") mean, per policy:
+ * - LRU: access count at the line's last use; the victim is the oldest
+ * - FIFO: access count at the line's fill
+ * - random: unused
+ * - PLRU: words 0..E-2 are the nodes of a binary tree over the lines,
+ *   each pointing (0 left, 1 right) towards the less recently used half
+ * - SRRIP/BRRIP: the line's 2-bit re-reference prediction value; hits
+ *   set it to 0, fills to 2 (BRRIP: usually 3), and the victim is a line
+ *   at 3, after ageing the whole set until one is
+ * - OPT: the time of the block's next use, from Cache.nextUse; the
+ *   victim is the line used furthest in the future
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include "cachemodel.h"
+
+#define RRPV_MAX 3     // 2-bit RRIP values
+#define BRRIP_LONG 32  // BRRIP inserts at RRPV_MAX - 1 once in this many
+
+const char* policyNames[POLICY_COUNT] = {"lru",   "fifo",  "random", "plru",
+                                         "srrip", "brrip", "opt"};
+
+/**
+ * Allocate an empty cache of 2^s sets of E lines of 2^b bytes
+ * @return 0 on success, -1 if the geometry is invalid or out of memory
+ */
+int cacheInit(Cache* c, int s, int E, int b) {
+    size_t lines, bytes;
+    char* mem;
+
+    if (s < 0 || E <= 0 || b < 0 || s + b >= 64) {
+        return -1;
+    }
+    c->s = s;
+    c->E = E;
+    c->b = b;
+    c->S = 1UL << s;
+    c->validWords = (E + 63) / 64;
+    c->accessCount = 0;
+    c->policy = POLICY_LRU;
+    c->rng = 1;
+    c->nextUse = 0;
+
+    // tags, then stamps, then valid and dirty bits
+    lines = c->S * E;
+    bytes = 2 * lines * sizeof(unsigned long) +
+            2 * c->S * c->validWords * sizeof(uint64_t);
+    if ((mem = calloc(1, bytes)) == NULL) {
+        return -1;
+    }
+    c->tags = (unsigned long*)mem;
+    c->stamps = c->tags + lines;
+    c->valid = (uint64_t*)(c->stamps + lines);
+    c->dirty = c->valid + c->S * c->validWords;
+    return 0;
+}
+
+/**
+ * Free a cache's storage
+ */
+void cacheFree(Cache* c) {
+    free(c->tags);
+    c->tags = NULL;
+}
+
+/**
+ * Look up a policy by name
+ * @return its POLICY_* number, or -1
+ */
+int parsePolicy(const char* name) {
+    for (int p = 0; p < POLICY_COUNT; p++) {
+        if (!strcmp(name, policyNames[p])) {
+            return p;
+        }
+    }
+    return -1;
+}
+
+/**
+ * Choose the replacement policy of a cache before its first access
+ * @param seed seeds the generator of the random and BRRIP policies
+ * @return 0, or -1 if the policy does not suit the cache
+ */
+int cacheSetPolicy(Cache* c, int policy, unsigned long seed) {
+    if (policy < 0 || policy >= POLICY_COUNT ||
+        (policy == POLICY_PLRU && (c->E & (c->E - 1)))) {
+        return -1;
+    }
+    c->policy = policy;
+    c->rng = seed * 2 + 1;  // xorshift state must not be 0
+    return 0;
+}
+
+/**
+ * Next number from the cache's xorshift64 generator
+ */
+static uint64_t nextRandom(Cache* c) {
+    c->rng ^= c->rng << 13;
+    c->rng ^= c->rng >> 7;
+    c->rng ^= c->rng << 17;
+    return c->rng;
+}
+
+/**
+ * Find the valid line holding tag in a set
+ * @return its index, or -1
+ */
+static int findLine(const Cache* c, const unsigned long* tags,
+                    const uint64_t* valid, unsigned long tag) {
+    for (int w = 0; w < c->validWords; w++) {
+        int base = w * 64;
+        int n = c->E - base < 64 ? c->E - base : 64;
+        uint64_t match = 0;
+        for (int i = 0; i < n; i++) {
+            match |= (uint64_t)(tags[base + i] == tag) << i;
+        }
+        match &= valid[w];
+        if (match) {
+            return base + __builtin_ctzll(match);
+        }
+    }
+    return -1;
+}
+
+/**
+ * Find an empty line in a set
+ * @return its index, or -1 if the set is full
+ */
+static int findEmpty(const Cache* c, const uint64_t* valid) {
+    for (int w = 0; w < c->validWords; w++) {
+        int i = w * 64 + (~valid[w] ? __builtin_ctzll(~valid[w]) : 64);
+        if (i < (w + 1) * 64 && i < c->E) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+/**
+ * Update the replacement state of line i of a set after it was used
+ * @param fill whether the line was just filled rather than hit
+ */
+static void touch(Cache* c, unsigned long* stamps, int i, int fill) {
+    switch (c->policy) {
+        case POLICY_LRU:
+            stamps[i] = c->accessCount;
+            break;
+        case POLICY_FIFO:
+            if (fill) {
+                stamps[i] = c->accessCount;
+            }
+            break;
+        case POLICY_PLRU: {
+            // point every node on the way to line i away from it
+            int node = 0, lo = 0, span = c->E;
+            while (span > 1) {
+                span /= 2;
+                if (i < lo + span) {
+                    stamps[node] = 1;
+                    node = 2 * node + 1;
+                } else {
+                    stamps[node] = 0;
+                    node = 2 * node + 2;
+                    lo += span;
+                }
+            }
+            break;
+        }
+        case POLICY_SRRIP:
+            stamps[i] = fill ? RRPV_MAX - 1 : 0;
+            break;
+        case POLICY_BRRIP:
+            if (!fill) {
+                stamps[i] = 0;
+            } else if (nextRandom(c) % BRRIP_LONG == 0) {
+                stamps[i] = RRPV_MAX - 1;
+            } else {
+                stamps[i] = RRPV_MAX;
+            }
+            break;
+        case POLICY_OPT:
+            stamps[i] = c->nextUse;
+            break;
+        default:
+            break;
+    }
+}
+
+/**
+ * Choose the line of a full set to replace
+ * @return its index
+ */
+static int findVictim(Cache* c, unsigned long* stamps) {
+    int i = 0;
+
+    switch (c->policy) {
+        case POLICY_LRU:
+        case POLICY_FIFO:
+            for (int j = 1; j < c->E; j++) {
+                if (stamps[j] < stamps[i]) {
+                    i = j;
+                }
+            }
+            break;
+        case POLICY_RANDOM:
+            i = nextRandom(c) % c->E;
+            break;
+        case POLICY_PLRU: {
+            int node = 0, span = c->E;
+            while (span > 1) {
+                span /= 2;
+                if (stamps[node]) {
+                    node = 2 * node + 2;
+                    i += span;
+                } else {
+                    node = 2 * node + 1;
+                }
+            }
+            break;
+        }
+        case POLICY_SRRIP:
+        case POLICY_BRRIP: {
+            // age the set so that its most distant line reaches RRPV_MAX
+            unsigned long max = 0;
+            for (int j = 0; j < c->E; j++) {
+                if (stamps[j] > max) {
+                    max = stamps[j];
+                    i = j;
+                }
+            }
+            for (int j = 0; j < c->E; j++) {
+                stamps[j] += RRPV_MAX - max;
+            }
+            break;
+        }
+        case POLICY_OPT:
+            for (int j = 1; j < c->E; j++) {
+                if (stamps[j] > stamps[i]) {
+                    i = j;
+                }
+            }
+            break;
+        default:
+            break;
+    }
+    return i;
+}
+
+/**
+ * Access the line holding an address, filling it on a miss
+ * @param flags CACHE_DIRTY to mark the line dirty, CACHE_NOALLOC to leave
+ *     the cache unchanged on a miss
+ * @param victim if not NULL, gets the line replaced by CACHE_EVICT
+ * @return CACHE_HIT, CACHE_MISS or CACHE_EVICT
+ */
+int cacheAccess(Cache* c, unsigned long address, int flags,
+                CacheVictim* victim) {
+    unsigned long tag = address >> (c->s + c->b);
+    unsigned long setIndex = (address >> c->b) & (c->S - 1);
+    unsigned long* tags = c->tags + setIndex * c->E;
+    unsigned long* stamps = c->stamps + setIndex * c->E;
+    uint64_t* valid = c->valid + setIndex * c->validWords;
+    uint64_t* dirty = c->dirty + setIndex * c->validWords;
+    int i, result = CACHE_MISS;
+
+    c->accessCount++;
+    if ((i = findLine(c, tags, valid, tag)) >= 0) {
+        result = CACHE_HIT;
+    } else if (flags & CACHE_NOALLOC) {
+        return CACHE_MISS;
+    } else if ((i = findEmpty(c, valid)) >= 0) {
+        valid[i / 64] |= 1ULL << (i % 64);
+    } else {
+        // set is full: let the policy pick the line to replace
+        i = findVictim(c, stamps);
+        if (victim != NULL) {
+            victim->address = (tags[i] << c->s | setIndex) << c->b;
+            victim->dirty = (dirty[i / 64] >> (i % 64)) & 1;
+        }
+        result = CACHE_EVICT;
+    }
+
+    if (result != CACHE_HIT) {
+        tags[i] = tag;
+        dirty[i / 64] &= ~(1ULL << (i % 64));
+    }
+    if (flags & CACHE_DIRTY) {
+        dirty[i / 64] |= 1ULL << (i % 64);
+    }
+    touch(c, stamps, i, result != CACHE_HIT);
+    return result;
+}
+
+/**
+ * Check whether an address is cached, without counting it as a use
+ */
+int cacheProbe(const Cache* c, unsigned long address) {
+    unsigned long tag = address >> (c->s + c->b);
+    unsigned long setIndex = (address >> c->b) & (c->S - 1);
+
+    return findLine(c, c->tags + setIndex * c->E,
+                    c->valid + setIndex * c->validWords, tag) >= 0;
+}
+
+/**
+ * Drop the line holding an address, if any
+ * @return -1 if it was not cached, otherwise whether it was dirty
+ */
+int cacheInvalidate(Cache* c, unsigned long address) {
+    unsigned long tag = address >> (c->s + c->b);
+    unsigned long setIndex = (address >> c->b) & (c->S - 1);
+    uint64_t* valid = c->valid + setIndex * c->validWords;
+    uint64_t* dirty = c->dirty + setIndex * c->validWords;
+    int i = findLine(c, c->tags + setIndex * c->E, valid, tag);
+
+    if (i < 0) {
+        return -1;
+    }
+    valid[i / 64] &= ~(1ULL << (i % 64));
+    return (dirty[i / 64] >> (i % 64)) & 1;
+}
@@ -0,0 +1,62 @@
+/**
+ * cachemodel.h - A set-associative cache, as used by csim and the other
+ * cache tools
+ */
+
+#ifndef CACHEMODEL_H
+#define CACHEMODEL_H
+
+#include <stdint.h>
+
+// result of one access
+#define CACHE_HIT 0
+#define CACHE_MISS 1   // filled an empty line
+#define CACHE_EVICT 2  // replaced a valid line
+
+// cacheAccess flags
+#define CACHE_DIRTY 0x1    // the access writes the line (write-back)
+#define CACHE_NOALLOC 0x2  // do not fill the line on a miss
+
+// replacement policies
+#define POLICY_LRU 0     // least recently used
+#define POLICY_FIFO 1    // oldest fill
+#define POLICY_RANDOM 2  // uniformly random, from a seeded generator
+#define POLICY_PLRU 3    // tree pseudo-LRU, E a power of two
+#define POLICY_SRRIP 4   // static re-reference interval prediction
+#define POLICY_BRRIP 5   // bimodal RRIP
+#define POLICY_OPT 6     // Belady's optimal, needs Cache.nextUse
+#define POLICY_COUNT 7
+
+// a line pushed out of the cache
+typedef struct {
+    unsigned long address;  // block address
+    int dirty;
+} CacheVictim;
+
+// the whole cache, laid out as structure-of-arrays in one allocation
+typedef struct {
+    int s, E, b;
+    unsigned long S;          // number of sets
+    int validWords;           // 64-bit words of valid bits per set
+    unsigned long* tags;      // S x E tags, set-major
+    unsigned long* stamps;    // S x E replacement state, see cachemodel.c
+    uint64_t* valid;          // S x validWords valid-line bitmaps
+    uint64_t* dirty;          // S x validWords dirty-line bitmaps
+    unsigned long accessCount;
+    int policy;               // POLICY_*
+    uint64_t rng;             // random and BRRIP generator state
+    unsigned long nextUse;    // OPT: when this access's block is next used
+} Cache;
+
+extern const char* policyNames[POLICY_COUNT];
+
+int cacheInit(Cache* c, int s, int E, int b);
+void cacheFree(Cache* c);
+int parsePolicy(const char* name);
+int cacheSetPolicy(Cache* c, int policy, unsigned long seed);
+int cacheAccess(Cache* c, unsigned long address, int flags,
+                CacheVictim* victim);
+int cacheInvalidate(Cache* c, unsigned long address);
+int cacheProbe(const Cache* c, unsigned long address);
+
+#endif /* CACHEMODEL_H */
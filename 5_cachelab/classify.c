@@ -0,0 +1,161 @@
+/**
+ * classify.c - Compulsory/capacity/conflict classification of misses
+ *
+ * Every access also goes to a shadow cache: fully associative, LRU, with
+ * as many lines as the simulated cache. A miss in the simulated cache is
+ * compulsory if the block was never referenced before, a conflict miss
+ * if the shadow cache still holds the block, and a capacity miss
+ * otherwise. The shadow cache is a hash map from blocks to lines plus a
+ * doubly-linked LRU list, so an access costs O(1) whatever its size.
+ *
+ * Regions come from a text file of "name start end" lines, addresses in
+ * hex and end exclusive, as tracegen writes to .regions.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "classify.h"
+
+#define NO_LINE (~0UL)
+#define MAX_REGIONS 64
+
+/**
+ * Create an empty shadow cache of the given number of lines of 2^b bytes
+ * @return 0, or -1 if out of memory
+ */
+int classifierInit(MissClassifier* mc, unsigned long lines, int b) {
+    mc->b = b;
+    mc->lines = lines;
+    mc->used = 0;
+    mc->head = mc->tail = NO_LINE;
+    mc->blocks = malloc(3 * lines * sizeof(unsigned long));
+    if (mc->blocks == NULL || blockMapInit(&mc->seen) < 0) {
+        free(mc->blocks);
+        return -1;
+    }
+    mc->prev = mc->blocks + lines;
+    mc->next = mc->prev + lines;
+    return 0;
+}
+
+/**
+ * Free a classifier's storage
+ */
+void classifierFree(MissClassifier* mc) {
+    free(mc->blocks);
+    blockMapFree(&mc->seen);
+}
+
+/**
+ * Take a shadow line out of the LRU list
+ */
+static void unlinkLine(MissClassifier* mc, unsigned long line) {
+    if (mc->prev[line] != NO_LINE) {
+        mc->next[mc->prev[line]] = mc->next[line];
+    } else {
+        mc->head = mc->next[line];
+    }
+    if (mc->next[line] != NO_LINE) {
+        mc->prev[mc->next[line]] = mc->prev[line];
+    } else {
+        mc->tail = mc->prev[line];
+    }
+}
+
+/**
+ * Put a shadow line at the most recently used end of the list
+ */
+static void pushFront(MissClassifier* mc, unsigned long line) {
+    mc->prev[line] = NO_LINE;
+    mc->next[line] = mc->head;
+    if (mc->head != NO_LINE) {
+        mc->prev[mc->head] = line;
+    } else {
+        mc->tail = line;
+    }
+    mc->head = line;
+}
+
+/**
+ * Run one access through the shadow cache
+ * @return the MISS_* kind a miss of this access in the simulated cache
+ *     is, or -1 if out of memory
+ */
+int classifyAccess(MissClassifier* mc, unsigned long address) {
+    unsigned long block = address >> mc->b;
+    unsigned long line;
+    int isNew, kind;
+    unsigned long* entry = blockMapGet(&mc->seen, block, &isNew);
+
+    if (entry == NULL) {
+        return -1;
+    }
+    if (*entry) {
+        // shadow hit: only the mapping made the simulated cache miss
+        unlinkLine(mc, *entry - 1);
+        pushFront(mc, *entry - 1);
+        return MISS_CONFLICT;
+    }
+    kind = isNew ? MISS_COMPULSORY : MISS_CAPACITY;
+
+    if (mc->used < mc->lines) {
+        line = mc->used++;
+    } else {
+        line = mc->tail;
+        unlinkLine(mc, line);
+        *blockMapGet(&mc->seen, mc->blocks[line], NULL) = 0;
+    }
+    mc->blocks[line] = block;
+    pushFront(mc, line);
+    *entry = line + 1;
+    return kind;
+}
+
+/**
+ * Read a regions file; an "other" region for all remaining addresses
+ * is added at the end
+ * @param regions set to a malloc'd array
+ * @return the number of regions, or -1 (with a message) on failure
+ */
+int loadRegions(const char* path, Region** regions) {
+    FILE* fp = fopen(path, "r");
+    Region* r;
+    int n = 0;
+
+    if (fp == NULL) {
+        perror(path);
+        return -1;
+    }
+    if ((r = calloc(MAX_REGIONS + 1, sizeof(Region))) == NULL) {
+        fclose(fp);
+        return -1;
+    }
+    while (n < MAX_REGIONS && fscanf(fp, "%31s %lx %lx", r[n].name,
+                                     &r[n].start, &r[n].end) == 3) {
+        n++;
+    }
+    if (!feof(fp) && n < MAX_REGIONS) {
+        fprintf(stderr, "%s: bad region on line %d\n", path, n + 1);
+        fclose(fp);
+        free(r);
+        return -1;
+    }
+    fclose(fp);
+    strcpy(r[n].name, "other");
+    r[n].end = ~0UL;
+    *regions = r;
+    return n + 1;
+}
+
+/**
+ * The first region containing an address; the last region catches all
+ */
+Region* findRegion(Region* regions, int n, unsigned long address) {
+    for (int i = 0; i < n - 1; i++) {
+        if (address >= regions[i].start && address < regions[i].end) {
+            return &regions[i];
+        }
+    }
+    return &regions[n - 1];
+}
@@ -0,0 +1,43 @@
+/**
+ * classify.h - Compulsory/capacity/conflict classification of misses and
+ * their attribution to address regions
+ */
+
+#ifndef CLASSIFY_H
+#define CLASSIFY_H
+
+#include "blockmap.h"
+
+// kinds of miss
+#define MISS_COMPULSORY 0  // first reference to the block
+#define MISS_CAPACITY 1    // a fully-associative cache would miss too
+#define MISS_CONFLICT 2    // a fully-associative cache would hit
+#define MISS_KINDS 3
+
+// a fully-associative LRU cache of the same capacity, and every block
+// ever referenced
+typedef struct {
+    int b;
+    unsigned long lines, used;
+    BlockMap seen;          // block -> shadow line + 1, or 0 if not cached
+    unsigned long* blocks;  // block held by each shadow line
+    unsigned long* prev;    // LRU list through the lines, most recent first
+    unsigned long* next;
+    unsigned long head, tail;
+} MissClassifier;
+
+// a named address range [start, end) and the accesses that fell in it
+typedef struct {
+    char name[32];
+    unsigned long start, end;
+    unsigned long hits, misses[MISS_KINDS];
+} Region;
+
+int classifierInit(MissClassifier* mc, unsigned long lines, int b);
+void classifierFree(MissClassifier* mc);
+int classifyAccess(MissClassifier* mc, unsigned long address);
+
+int loadRegions(const char* path, Region** regions);
+Region* findRegion(Region* regions, int n, unsigned long address);
+
+#endif /* CLASSIFY_H */
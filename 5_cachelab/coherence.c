@@ -0,0 +1,297 @@
+/**
+ * coherence.c - Private per-core caches kept coherent by MESI or MOESI
+ *
+ * Each core has its own cachemodel cache, which decides what fits and
+ * what gets replaced. The coherence state of every block is kept apart
+ * in a blockmap, four bits per core: the MOESI state in the low three
+ * and a flag set when another core's write took the line away. A core
+ * that misses on a line with that flag set has a coherence miss.
+ *
+ * The bus is atomic. A read miss (BusRd) demotes a modified or
+ * exclusive copy elsewhere to shared. Under MOESI a modified copy turns
+ * owned instead and keeps the dirty data. A write to a shared or owned
+ * line (BusUpgr), or a write miss (BusRdX), invalidates every other
+ * copy.
+ *
+ * False sharing is told apart from true sharing by the bytes of the line
+ * other cores have written since a core lost it (a 64-bit mask per line,
+ * so a bit covers 2^b / 64 bytes of longer lines): a coherence miss that
+ * touches none of them would not have happened without the sharing of
+ * the line.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "coherence.h"
+
+// line states
+#define ST_I 0
+#define ST_S 1
+#define ST_E 2
+#define ST_O 3
+#define ST_M 4
+#define ST_LOST 0x8  // invalidated by another core's write
+
+#define STATE(v, c) ((int)((v) >> (4 * (c))) & 0xf)
+#define SET_STATE(v, c, st) \
+    ((v) = ((v) & ~(0xfUL << (4 * (c)))) | ((unsigned long)(st) << (4 * (c))))
+
+const char* protocolNames[2] = {"mesi", "moesi"};
+
+/**
+ * Set up n empty caches of 2^s sets of E lines of 2^b bytes
+ * @return 0, or -1 if the geometry is invalid or out of memory
+ */
+int coherenceInit(Coherence* co, int n, int protocol, int s, int E, int b,
+                  int policy) {
+    memset(co, 0, sizeof(*co));
+    co->n = n;
+    co->protocol = protocol;
+    co->b = b;
+    for (int c = 0; c < n; c++) {
+        if (cacheInit(&co->caches[c], s, E, b) < 0 ||
+            cacheSetPolicy(&co->caches[c], policy, c + 1) < 0) {
+            return -1;
+        }
+    }
+    if (blockMapInit(&co->lines) < 0 || blockMapInit(&co->written) < 0 ||
+        blockMapInit(&co->spotIndex) < 0) {
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * Free all caches and tables
+ */
+void coherenceFree(Coherence* co) {
+    for (int c = 0; c < co->n; c++) {
+        cacheFree(&co->caches[c]);
+    }
+    blockMapFree(&co->lines);
+    blockMapFree(&co->written);
+    blockMapFree(&co->spotIndex);
+    free(co->spots);
+}
+
+/**
+ * The hotspot record of a block, created on first use
+ */
+static Hotspot* hotspot(Coherence* co, unsigned long block) {
+    unsigned long* index = blockMapGet(&co->spotIndex, block, NULL);
+
+    if (index == NULL) {
+        return NULL;
+    }
+    if (*index == 0) {
+        if (co->nSpots == co->spotCap) {
+            unsigned long cap = co->spotCap ? 2 * co->spotCap : 256;
+            Hotspot* grown = realloc(co->spots, cap * sizeof(Hotspot));
+            if (grown == NULL) {
+                return NULL;
+            }
+            co->spots = grown;
+            co->spotCap = cap;
+        }
+        memset(&co->spots[co->nSpots], 0, sizeof(Hotspot));
+        co->spots[co->nSpots].block = block;
+        *index = ++co->nSpots;
+    }
+    return &co->spots[*index - 1];
+}
+
+/**
+ * Mask of the parts of a line that size bytes at address touch
+ */
+static uint64_t byteMask(const Coherence* co, unsigned long address,
+                         unsigned size) {
+    int shift = co->b > 6 ? co->b - 6 : 0;  // bytes per bit, log2
+    unsigned long line = 1UL << co->b;
+    unsigned long first = address & (line - 1);
+    unsigned long last = first + (size ? size : 1) - 1;
+
+    if (last >= line) {
+        last = line - 1;  // the rest is in the next line
+    }
+    first >>= shift;
+    last >>= shift;
+    return (last == 63 ? ~0ULL : (1ULL << (last + 1)) - 1) &
+           ~((1ULL << first) - 1);
+}
+
+/**
+ * Take a line away from every core but one, for a write
+ * @return whether another cache supplied the data
+ */
+static int invalidateOthers(Coherence* co, int core, unsigned long address,
+                            unsigned long* state, Hotspot* spot) {
+    unsigned long block = address >> co->b;
+    int supplied = 0;
+
+    for (int c = 0; c < co->n; c++) {
+        int st = STATE(*state, c) & 7;
+        if (c == core || st == ST_I) {
+            continue;
+        }
+        supplied |= st == ST_M || st == ST_O;
+        cacheInvalidate(&co->caches[c], address);
+        SET_STATE(*state, c, ST_I | ST_LOST);
+        *blockMapGet(&co->written, block << 4 | c, NULL) = 0;
+        co->cores[c].invalidated++;
+        spot->invalidations++;
+    }
+    return supplied;
+}
+
+/**
+ * Simulate one access by one core
+ * @param size bytes accessed, for telling false sharing from true
+ * @return the core's CACHE_* result, or -1 if out of memory
+ */
+int coherenceAccess(Coherence* co, int core, unsigned long address,
+                    unsigned size, int write) {
+    unsigned long block = address >> co->b;
+    CoreStats* cs = &co->cores[core];
+    uint64_t mask = byteMask(co, address, size);
+    CacheVictim victim;
+    unsigned long *state, *lostBytes;
+    Hotspot* spot;
+    int st, lost, result;
+
+    // make sure every table has its entries before taking pointers
+    if ((spot = hotspot(co, block)) == NULL ||
+        blockMapGet(&co->written, block << 4 | core, NULL) == NULL ||
+        (state = blockMapGet(&co->lines, block, NULL)) == NULL) {
+        return -1;
+    }
+    st = STATE(*state, core) & 7;
+    lost = STATE(*state, core) & ST_LOST;
+
+    // the core's own cache: replacement, and the victim loses its state
+    result = cacheAccess(&co->caches[core], address, 0, &victim);
+    if (result == CACHE_EVICT) {
+        unsigned long* vstate =
+            blockMapGet(&co->lines, victim.address >> co->b, NULL);
+        int vst = STATE(*vstate, core) & 7;
+        if (vst == ST_M || vst == ST_O) {
+            co->writebacks++;
+        }
+        SET_STATE(*vstate, core, ST_I);
+        cs->evictions++;
+    }
+
+    if (st == ST_I) {
+        cs->misses++;
+        if (lost) {
+            // was the miss caused by a write to bytes this core uses?
+            lostBytes = blockMapGet(&co->written, block << 4 | core, NULL);
+            cs->coherenceMisses++;
+            spot->coherenceMisses++;
+            if (!(*lostBytes & mask)) {
+                cs->falseSharing++;
+                spot->falseSharing++;
+            }
+        }
+    } else {
+        cs->hits++;
+    }
+
+    if (!write) {
+        if (st == ST_I) {
+            int shared = 0;
+            co->busReads++;
+            for (int c = 0; c < co->n; c++) {
+                int other = STATE(*state, c) & 7;
+                if (c == core || other == ST_I) {
+                    continue;
+                }
+                shared = 1;
+                if (other == ST_M) {
+                    co->transfers++;
+                    if (co->protocol == PROTO_MOESI) {
+                        SET_STATE(*state, c, ST_O);
+                    } else {
+                        co->writebacks++;
+                        SET_STATE(*state, c, ST_S);
+                    }
+                } else if (other == ST_O) {
+                    co->transfers++;
+                } else if (other == ST_E) {
+                    SET_STATE(*state, c, ST_S);
+                }
+            }
+            SET_STATE(*state, core, shared ? ST_S : ST_E);
+        }
+    } else {
+        if (st == ST_S || st == ST_O) {
+            co->busUpgrades++;
+            cs->upgrades++;
+            invalidateOthers(co, core, address, state, spot);
+        } else if (st == ST_I) {
+            co->busReadX++;
+            if (invalidateOthers(co, core, address, state, spot)) {
+                co->transfers++;
+            }
+        }
+        SET_STATE(*state, core, ST_M);
+
+        // note the bytes for the cores that have lost the line
+        for (int c = 0; c < co->n; c++) {
+            if (c != core && (STATE(*state, c) & ST_LOST)) {
+                *blockMapGet(&co->written, block << 4 | c, NULL) |= mask;
+            }
+        }
+    }
+    return result;
+}
+
+/**
+ * qsort order: most false sharing first, then most coherence misses
+ */
+static int compareSpots(const void* a, const void* b) {
+    const Hotspot* x = a;
+    const Hotspot* y = b;
+
+    if (x->falseSharing != y->falseSharing) {
+        return x->falseSharing < y->falseSharing ? 1 : -1;
+    }
+    if (x->coherenceMisses != y->coherenceMisses) {
+        return x->coherenceMisses < y->coherenceMisses ? 1 : -1;
+    }
+    return x->block < y->block ? -1 : x->block > y->block;
+}
+
+/**
+ * Print per-core and bus statistics and the top lines by false sharing
+ */
+void printCoherence(const Coherence* co, int top) {
+    Hotspot* sorted;
+
+    for (int c = 0; c < co->n; c++) {
+        const CoreStats* cs = &co->cores[c];
+        printf("core %d hits:%lu misses:%lu evictions:%lu coherence:%lu "
+               "false-sharing:%lu invalidated:%lu upgrades:%lu\n",
+               c, cs->hits, cs->misses, cs->evictions, cs->coherenceMisses,
+               cs->falseSharing, cs->invalidated, cs->upgrades);
+    }
+    printf("bus %s reads:%lu read-exclusive:%lu upgrades:%lu transfers:%lu "
+           "writebacks:%lu\n",
+           protocolNames[co->protocol], co->busReads, co->busReadX,
+           co->busUpgrades, co->transfers, co->writebacks);
+
+    if ((sorted = malloc(co->nSpots * sizeof(Hotspot) + 1)) == NULL) {
+        return;
+    }
+    memcpy(sorted, co->spots, co->nSpots * sizeof(Hotspot));
+    qsort(sorted, co->nSpots, sizeof(Hotspot), compareSpots);
+    for (unsigned long i = 0; i < co->nSpots && i < (unsigned long)top; i++) {
+        if (sorted[i].coherenceMisses == 0 && sorted[i].invalidations == 0) {
+            break;
+        }
+        printf("line %lx coherence:%lu false-sharing:%lu invalidations:%lu\n",
+               sorted[i].block << co->b, sorted[i].coherenceMisses,
+               sorted[i].falseSharing, sorted[i].invalidations);
+    }
+    free(sorted);
+}
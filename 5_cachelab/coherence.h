@@ -0,0 +1,56 @@
+/**
+ * coherence.h - Private per-core caches kept coherent by MESI or MOESI
+ * snooping on a shared bus
+ */
+
+#ifndef COHERENCE_H
+#define COHERENCE_H
+
+#include "blockmap.h"
+#include "cachemodel.h"
+
+#define MAX_CORES 16
+
+#define PROTO_MESI 0
+#define PROTO_MOESI 1
+
+// what one core saw
+typedef struct {
+    unsigned long hits, misses, evictions;
+    unsigned long coherenceMisses;  // misses on lines another core took
+    unsigned long falseSharing;     // ... without writing the bytes read
+    unsigned long invalidated;      // lines other cores' writes took
+    unsigned long upgrades;         // writes to shared lines
+} CoreStats;
+
+// coherence activity on one cache line
+typedef struct {
+    unsigned long block;
+    unsigned long coherenceMisses, falseSharing, invalidations;
+} Hotspot;
+
+typedef struct {
+    int n, protocol, b;
+    Cache caches[MAX_CORES];
+    CoreStats cores[MAX_CORES];
+    BlockMap lines;    // block -> 4 bits of state per core
+    BlockMap written;  // block and core -> bytes written by others since
+                       // the core lost the line
+    BlockMap spotIndex;  // block -> index in spots + 1
+    Hotspot* spots;
+    unsigned long nSpots, spotCap;
+    unsigned long busReads, busReadX, busUpgrades;
+    unsigned long transfers;   // lines supplied by another cache
+    unsigned long writebacks;  // dirty lines written to memory
+} Coherence;
+
+extern const char* protocolNames[2];
+
+int coherenceInit(Coherence* co, int n, int protocol, int s, int E, int b,
+                  int policy);
+void coherenceFree(Coherence* co);
+int coherenceAccess(Coherence* co, int core, unsigned long address,
+                    unsigned size, int write);
+void printCoherence(const Coherence* co, int top);
+
+#endif /* COHERENCE_H */
@@ -6,38 +6,100 @@
  */
 
 #include <getopt.h>
+#include <limits.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <unistd.h>
+#include "blockmap.h"
 #include "cachelab.h"
+#include "classify.h"
+#include "coherence.h"
+#include "hierarchy.h"
+#include "prefetch.h"
+#include "tlb.h"
+#include "tracefile.h"
 
-// cache line
-typedef struct {
-    int valid;               // 0: invalid, 1: valid
-    unsigned int tag;        // tag
-    unsigned int timeStamp;  // last visit time
-} CacheLine;
-typedef CacheLine* CacheSet;
-
-int s, E, b, S, B;
-CacheSet* cache;
-FILE* fp;
+int s, E, b;
+Hierarchy hier;  // level 1 is the -s/-E/-b cache
+TraceFile trace;
 int hits, misses, evictions;  // final results
 int verbose = 0;
+int showLevels = 0;  // print per-level statistics too
+unsigned long* nextUse = NULL;  // OPT: next use of each access's block
+size_t accessIndex = 0;
+int classify = 0;  // break L1 misses down into the three Cs
+MissClassifier classifier;
+unsigned long missKinds[MISS_KINDS];
+Region* regions = NULL;  // attribute L1 accesses to these, if not NULL
+int nRegions;
+int useMarkers = 0;  // only simulate from a start to an end marker access
+int traceMarkers = 0;  // take the markers from the trace's marker line
+unsigned long markerStart, markerEnd;
+unsigned long addressLimit = ~0UL;  // ignore accesses at or above this
+int protocol = -1;  // PROTO_*: one coherent core per trace
+Coherence coherence;
+TraceFile coreTraces[MAX_CORES];
+int nTraces = 0;
+Prefetcher prefetcher;  // level 1 prefetcher, if hier.prefetcher is set
+int useTlb = 0;  // translate every access through a TLB too
+Tlb tlb;
 
 void printUsage() {
     printf(
-        "Usage: ./csim [-hv] -s <num> -E <num> -b <num> -t <file>\n"
+        "Usage: ./csim [-hvc] -s <num> -E <num> -b <num> [-r <policy>]\n"
+        "              [-R <seed>] [-w <opts>] [-L <level>]... [-a <file>]\n"
+        "              [-m <markers>] [-l <addr>] [-p <protocol>]\n"
+        "              [-P <prefetcher>] [-T <tlb>] -t <file> [-t <file>]...\n"
         "Options:\n"
         "  -h         Print this help message.\n"
         "  -v         Optional verbose flag.\n"
+        "  -c         Classify L1 misses as compulsory, capacity or\n"
+        "             conflict.\n"
+        "  -a <file>  Classify L1 accesses by the address regions in file\n"
+        "             (\"name start end\" lines, as in tracegen's .regions).\n"
         "  -s <num>   Number of set index bits.\n"
         "  -E <num>   Number of lines per set.\n"
         "  -b <num>   Number of block offset bits.\n"
-        "  -t <file>  Trace file.\n\n"
+        "  -t <file>  Trace file (lackey text, or binary from traceconv);\n"
+        "             - streams it from standard input.\n"
+        "  -m <markers> Simulate only from an access to the start marker\n"
+        "             to an access to the end marker: <start>,<end> in\n"
+        "             hex, or \"trace\" for the trace's marker line.\n"
+        "  -l <addr>  Ignore accesses at or above this hex address.\n"
+        "  -p <protocol> Simulate one core with a private cache per trace,\n"
+        "             kept coherent by mesi (the default for several -t)\n"
+        "             or moesi; traces are interleaved a record at a time.\n"
+        "  -r <policy> Level 1 replacement: lru (default), fifo, random,\n"
+        "             plru, srrip, brrip or opt (Belady, reads the trace\n"
+        "             twice; not with -P).\n"
+        "  -R <seed>  Seed for random and brrip replacement (default 1).\n"
+        "  -w <opts>  Level 1 write policy: wb|wt,wa|nwa (default wb,wa).\n"
+        "  -L <level> Add a lower level: s=<num>,E=<num>,b=<num> followed by\n"
+        "             incl|excl|nine (default nine), write policy and a\n"
+        "             replacement policy other than opt.\n"
+        "  -P <prefetcher> Level 1 prefetcher: next, stride or stream,\n"
+        "             then ,degree=<num> (lines ahead, stream buffer\n"
+        "             depth), ,latency=<num> (accesses until a prefetch\n"
+        "             arrives, default 10) and ,streams=<num> (default 4).\n"
+        "  -T <tlb>   Also simulate a DTLB and STLB: page=4k|2m,\n"
+        "             dtlb=<sets>x<ways>, stlb=<sets>x<ways>|none,\n"
+        "             pwc=<entries> (page walk cache) and walk (walk loads\n"
+        "             go through the caches), any of them, or \"\" for the\n"
+        "             defaults.\n\n"
         "Examples:\n"
         "  linux>  ./csim -s 4 -E 1 -b 4 -t traces/yi.trace\n"
-        "  linux>  ./csim -v -s 8 -E 2 -b 4 -t traces/yi.trace\n");
+        "  linux>  ./csim -v -s 8 -E 2 -b 4 -t traces/yi.trace\n"
+        "  linux>  ./csim -s 4 -E 8 -b 4 -r opt -t traces/trans.trace\n"
+        "  linux>  ./csim -s 5 -E 1 -b 5 -a .regions -t trace.f0\n"
+        "  linux>  valgrind --tool=lackey --trace-mem=yes --log-fd=1 "
+        "./tracegen -M 32 -N 32 |\n"
+        "          ./csim -s 5 -E 1 -b 5 -m trace -l ffffffff -t -\n"
+        "  linux>  ./csim -s 6 -E 8 -b 6 -p moesi -t t0.trace -t t1.trace\n"
+        "  linux>  ./csim -s 6 -E 8 -b 6 -L s=9,E=8,b=6,incl "
+        "-t traces/trans.trace\n"
+        "  linux>  ./csim -s 5 -E 1 -b 5 -P stream,degree=4 -t trace.f0\n"
+        "  linux>  ./csim -s 6 -E 8 -b 6 -T page=2m,walk -t trace.f0\n");
     return;
 }
 
@@ -46,10 +108,15 @@ void printUsage() {
  */
 int getArgs(int argc, char* argv[]) {
     int opt;
-    char* traceFile;
+    char* traceFiles[MAX_CORES];
+    char* prefetchSpec = NULL;
 
-    // get arguments, -h -v -s -E -b -t
-    while ((opt = getopt(argc, argv, "hvs:E:b:t:")) != -1) {
+    // get arguments, -h -v -c -s -E -b -t -r -R -w -L -a -m -l -p -P -T
+    hier.n = 1;
+    hier.seed = 1;
+    defaultLevel(&hier.levels[0]);
+    while ((opt = getopt(argc, argv,
+                         "hvcs:E:b:t:r:R:w:L:a:m:l:p:P:T:")) != -1) {
         switch (opt) {
             case 'h':
                 printUsage();
@@ -57,6 +124,15 @@ int getArgs(int argc, char* argv[]) {
             case 'v':
                 verbose = 1;
                 break;
+            case 'c':
+                classify = 1;
+                break;
+            case 'a':
+                if ((nRegions = loadRegions(optarg, &regions)) < 0) {
+                    exit(-1);
+                }
+                classify = 1;
+                break;
             case 's':
                 s = atoi(optarg);
                 break;
@@ -67,7 +143,74 @@ int getArgs(int argc, char* argv[]) {
                 b = atoi(optarg);
                 break;
             case 't':
-                traceFile = optarg;
+                if (nTraces == MAX_CORES) {
+                    fprintf(stderr, "at most %d traces\n", MAX_CORES);
+                    exit(-1);
+                }
+                traceFiles[nTraces++] = optarg;
+                break;
+            case 'p':
+                if (!strcmp(optarg, protocolNames[PROTO_MESI])) {
+                    protocol = PROTO_MESI;
+                } else if (!strcmp(optarg, protocolNames[PROTO_MOESI])) {
+                    protocol = PROTO_MOESI;
+                } else {
+                    fprintf(stderr, "unknown protocol: %s\n", optarg);
+                    exit(-1);
+                }
+                break;
+            case 'P':
+                // b may come later on the command line
+                prefetchSpec = optarg;
+                break;
+            case 'T':
+                if (tlbInit(&tlb, optarg) < 0) {
+                    exit(-1);
+                }
+                useTlb = 1;
+                break;
+            case 'r':
+                if ((hier.levels[0].policy = parsePolicy(optarg)) < 0) {
+                    fprintf(stderr, "unknown replacement policy: %s\n",
+                            optarg);
+                    exit(-1);
+                }
+                break;
+            case 'R':
+                hier.seed = strtoul(optarg, NULL, 0);
+                break;
+            case 'm':
+                useMarkers = 1;
+                if (!strcmp(optarg, "trace")) {
+                    traceMarkers = 1;
+                } else if (sscanf(optarg, "%lx,%lx", &markerStart,
+                                  &markerEnd) != 2) {
+                    fprintf(stderr, "-m needs <start>,<end> or trace\n");
+                    exit(-1);
+                }
+                break;
+            case 'l':
+                addressLimit = strtoul(optarg, NULL, 16);
+                break;
+            case 'w':
+                if (parseLevel(&hier.levels[0], optarg) < 0) {
+                    exit(-1);
+                }
+                showLevels = 1;
+                break;
+            case 'L':
+                if (hier.n == MAX_LEVELS) {
+                    fprintf(stderr, "at most %d levels\n", MAX_LEVELS);
+                    exit(-1);
+                }
+                Level* level = &hier.levels[hier.n++];
+                defaultLevel(level);
+                if (parseLevel(level, optarg) < 0 || level->s < 0 ||
+                    level->E <= 0 || level->b < 0) {
+                    fprintf(stderr, "-L needs s=, E= and b=\n");
+                    exit(-1);
+                }
+                showLevels = 1;
                 break;
             default:
                 break;
@@ -75,14 +218,53 @@ int getArgs(int argc, char* argv[]) {
     }
 
     // check if the arguments are valid
-    if (s <= 0 || E <= 0 || b <= 0 || traceFile == NULL) {
+    if (s <= 0 || E <= 0 || b <= 0 || nTraces == 0) {
         exit(-1);
     }
+    if (nTraces > 1 && protocol < 0) {
+        protocol = PROTO_MESI;
+    }
+    if (protocol >= 0 && (showLevels || classify || useMarkers ||
+                          prefetchSpec || useTlb ||
+                          hier.levels[0].policy == POLICY_OPT)) {
+        fprintf(stderr, "-p cannot be combined with -w, -L, -c, -a, -m, -P, "
+                        "-T or -r opt\n");
+        exit(-1);
+    }
+    if (useTlb && tlb.walkCaches && hier.levels[0].policy == POLICY_OPT) {
+        fprintf(stderr, "-r opt cannot see walk loads\n");
+        exit(-1);
+    }
+    if (prefetchSpec != NULL && hier.levels[0].policy == POLICY_OPT) {
+        fprintf(stderr, "-r opt cannot see prefetches\n");
+        exit(-1);
+    }
+    if (prefetchSpec != NULL) {
+        if (prefetchInit(&prefetcher, prefetchSpec, b) < 0) {
+            exit(-1);
+        }
+        hier.prefetcher = &prefetcher;
+    }
 
     // prepare global variables
-    fp = fopen(traceFile, "r");
-    S = 1 << s;
-    B = 1 << b;
+    hier.levels[0].s = s;
+    hier.levels[0].E = E;
+    hier.levels[0].b = b;
+    if (protocol >= 0) {
+        for (int i = 0; i < nTraces; i++) {
+            if (openTrace(&coreTraces[i], traceFiles[i]) < 0) {
+                exit(-1);
+            }
+        }
+        return 0;
+    }
+    if (openTrace(&trace, traceFiles[0]) < 0) {
+        exit(-1);
+    }
+    if (trace.stream && hier.levels[0].policy == POLICY_OPT) {
+        fprintf(stderr, "opt needs a trace file, not a stream\n");
+        exit(-1);
+    }
     return 0;
 }
 
@@ -90,142 +272,330 @@ int getArgs(int argc, char* argv[]) {
  * 2. Initialize cache
  */
 void initCache() {
-    // allocate memory for cache
-    cache = (CacheSet*)malloc(S * sizeof(CacheSet));
-    for (int i = 0; i < S; i++) {
-        cache[i] = (CacheLine*)malloc(E * sizeof(CacheLine));
-        cache[i]->valid = 0;
-        cache[i]->tag = 0;
-        cache[i]->timeStamp = 0;
+    // allocate memory for every level
+    if (hierarchyInit(&hier) < 0) {
+        exit(-1);
+    }
+    if (classify && classifierInit(&classifier, (1UL << s) * E, b) < 0) {
+        exit(-1);
     }
 }
 
 /**
- * 3. Simulate cache
+ * Follow the -m markers and the -l limit through the trace
+ * @param rec the next data access
+ * @param inRegion 1 between a start marker and an end marker; updated
+ * @return 1 if rec is simulated
  */
-void updateStamp() {
-    for (int i = 0; i < S; i++) {
-        for (int j = 0; j < E; j++) {
-            if (cache[i][j].valid == 1) {
-                cache[i][j].timeStamp++;
+int keepRecord(const TraceRecord* rec, int* inRegion) {
+    int known, keep;
+
+    if (traceMarkers && trace.markers) {
+        markerStart = trace.markerStart;
+        markerEnd = trace.markerEnd;
+    }
+    known = useMarkers && (!traceMarkers || trace.markers);
+    if (known && rec->address == markerStart) {
+        *inRegion = 1;
+    }
+    keep = *inRegion && rec->address < addressLimit;
+    if (known && rec->address == markerEnd) {
+        *inRegion = 0;
+    }
+    return keep;
+}
+
+/**
+ * First pass for OPT: record, for every access that is simulated, the
+ * index of the next simulated access to the same level 1 block
+ * (ULONG_MAX if none)
+ */
+void planOptimal() {
+    TraceRecord rec;
+    BlockMap last;
+    size_t n = 0, cap = 1 << 16;
+    int rc, inRegion = !useMarkers;
+
+    // the block of every access, in order
+    if ((nextUse = malloc(cap * sizeof(unsigned long))) == NULL) {
+        exit(-1);
+    }
+    while ((rc = nextRecord(&trace, &rec)) > 0) {
+        // the same accesses as simulate, so the indices line up
+        if (rec.op == 'I' || !keepRecord(&rec, &inRegion)) {
+            continue;
+        }
+        for (int k = rec.op == 'M' ? 2 : 1; k > 0; k--) {
+            if (n == cap && (nextUse = realloc(nextUse, (cap *= 2) *
+                                               sizeof(unsigned long))) == NULL) {
+                exit(-1);
             }
+            nextUse[n++] = rec.address >> b;
         }
     }
+    if (rc < 0) {
+        exit(-1);
+    }
+    rewindTrace(&trace);
+
+    // walk back, replacing each block with its next access
+    if (blockMapInit(&last) < 0) {
+        exit(-1);
+    }
+    for (size_t i = n; i-- > 0;) {
+        int isNew;
+        unsigned long* next = blockMapGet(&last, nextUse[i], &isNew);
+        if (next == NULL) {
+            exit(-1);
+        }
+        nextUse[i] = isNew ? ULONG_MAX : *next;
+        *next = i;
+    }
+    blockMapFree(&last);
 }
 
 /**
- * 4. Update cache
- * @param op operation
+ * 3. Update cache
+ * @param write 1 for a store, 0 for a load
  * @param address data address
  * @param size data size
  */
-void updateCache(char op, size_t address, unsigned int size) {
-    unsigned int tag = address >> (s + b);
-    unsigned int setIndex = (address >> b) & (S - 1);
-    CacheSet set = cache[setIndex];  // the set to be operated
-
-    for (int i = 0; i < E; i++) {
-        // find the cache line
-        if (set[i].valid && set[i].tag == tag) {  // hit
-            hits++;                               // update hits
-            set[i].timeStamp = 0;                 // restore the time
-            if (verbose) {
-                printf(" hit");
-            }
-            return;
+void updateCache(int write, size_t address, unsigned int size) {
+    static const char* tlbNames[] = {"hit", "stlb-hit", "walk"};
+    int kind = 0, result, tlbResult = TLB_HIT;
+    Region* region = NULL;
+
+    // translate first; the page walk loads go ahead of the access
+    if (useTlb) {
+        unsigned long refs[MAX_WALK];
+        int nRefs;
+        tlbResult = tlbAccess(&tlb, address, refs, &nRefs);
+        for (int k = 0; k < nRefs && tlb.walkCaches; k++) {
+            hierarchyAccess(&hier, refs[k], 0);
         }
     }
 
-    // miss
-    misses++;  // update misses
-    for (int i = 0; i < E; i++) {
-        if (!set[i].valid) {       // empty line
-            set[i].valid = 1;      // set valid
-            set[i].tag = tag;      //  set tag
-            set[i].timeStamp = 0;  // restore the time
+    if (nextUse != NULL) {
+        hier.levels[0].cache.nextUse = nextUse[accessIndex++];
+    }
+    if (classify && (kind = classifyAccess(&classifier, address)) < 0) {
+        exit(-1);
+    }
+    if (regions != NULL) {
+        region = findRegion(regions, nRegions, address);
+    }
+
+    result = hierarchyAccess(&hier, address, write);
+    if (result == CACHE_HIT) {
+        if (region != NULL) {
+            region->hits++;
+        }
+    } else {
+        missKinds[kind]++;
+        if (region != NULL) {
+            region->misses[kind]++;
+        }
+    }
+    switch (result) {
+        case CACHE_HIT:
+            hits++;
+            if (verbose) {
+                printf(" hit");
+            }
+            break;
+        case CACHE_MISS:
+            misses++;
             if (verbose) {
                 printf(" miss");
             }
-            return;
+            break;
+        default:
+            misses++;
+            evictions++;
+            if (verbose) {
+                printf(" miss eviction");
+            }
+            break;
+    }
+    if (verbose) {
+        printAccess(&hier);
+        if (useTlb) {
+            printf(" TLB:%s", tlbNames[tlbResult]);
         }
     }
+}
 
-    // eviction
-    evictions++;  // update evictions
-    unsigned int maxStamp = 0;
-    int maxStampIndex;
-    for (int i = 0; i < E; i++) {
-        // find the max time stamp
-        if (set[i].timeStamp > maxStamp) {
-            maxStamp = set[i].timeStamp;
-            maxStampIndex = i;
-        }
+/**
+ * 4. Simulate
+ */
+void simulateRecord(const TraceRecord* rec) {
+    if (verbose) {
+        printf("%c %lx,%u", rec->op, rec->address, rec->size);
     }
+
+    // update cache
+    switch (rec->op) {
+        case 'L':  // load
+            updateCache(0, rec->address, rec->size);
+            break;
+        case 'M':  // modify: load & store
+            updateCache(0, rec->address, rec->size);
+            /* breakthrough */
+        case 'S':  // store
+            updateCache(1, rec->address, rec->size);
+            break;
+        default:
+            break;
+    }
+
     if (verbose) {
-        printf(" miss eviction");
+        printf("\n");
     }
-    set[maxStampIndex].tag = tag;      // set tag
-    set[maxStampIndex].timeStamp = 0;  // restore the time
-    return;
 }
 
-/**
- * 5. Simulate
- */
 void simulate() {
-    char op;
-    size_t address;
-    unsigned int size;
-    while (fscanf(fp, "%c", &op) != EOF) {
-        // read the instruction, and ignore I
-        if (op == ' ') {
-            fscanf(fp, "%c", &op);
+    TraceRecord rec;
+    int rc, inRegion = !useMarkers;
+    while ((rc = nextRecord(&trace, &rec)) > 0) {
+        // ignore instruction fetches
+        if (rec.op == 'I') {
+            continue;
         }
-        fscanf(fp, " %lx,%u\n", &address, &size);
 
-        if (verbose) {
-            printf("%c %lx,%u", op, address, size);
+        // keep to the accesses from a start marker to an end marker
+        if (keepRecord(&rec, &inRegion)) {
+            simulateRecord(&rec);
         }
+    }
+    if (rc < 0) {
+        exit(-1);
+    }
+}
 
-        // update cache
-        switch (op) {
-            case 'L':  // load
-                updateCache(op, address, size);
-                break;
-            case 'M':  // modify: load & store
-                updateCache(op, address, size);
-                /* breakthrough */
-            case 'S':  // store
-                updateCache(op, address, size);
-                break;
-            default:
-                break;
-        }
+/**
+ * 4'. Simulate one core per trace, taking a record from each in turn
+ */
+void simulateCores() {
+    TraceRecord rec;
+    int running = nTraces, rc;
+    int done[MAX_CORES] = {0};
 
-        if (verbose) {
-            printf("\n");
-        }
+    if (coherenceInit(&coherence, nTraces, protocol, s, E, b,
+                      hier.levels[0].policy) < 0) {
+        fprintf(stderr, "cannot allocate %d caches with s=%d E=%d b=%d\n",
+                nTraces, s, E, b);
+        exit(-1);
+    }
+    while (running > 0) {
+        for (int core = 0; core < nTraces; core++) {
+            // next data access of this core
+            if (done[core]) {
+                continue;
+            }
+            do {
+                rc = nextRecord(&coreTraces[core], &rec);
+            } while (rc > 0 && (rec.op == 'I' || rec.address >= addressLimit));
+            if (rc < 0) {
+                exit(-1);
+            }
+            if (rc == 0) {
+                closeTrace(&coreTraces[core]);
+                done[core] = 1;
+                running--;
+                continue;
+            }
 
-        updateStamp();
+            if (verbose) {
+                printf("%d: %c %lx,%u", core, rec.op, rec.address, rec.size);
+            }
+            // L is a load, S a store and M a load then a store
+            for (int write = rec.op == 'S'; write <= (rec.op != 'L');
+                 write++) {
+                int result = coherenceAccess(&coherence, core, rec.address,
+                                             rec.size, write);
+                if (result < 0) {
+                    exit(-1);
+                }
+                hits += result == CACHE_HIT;
+                misses += result != CACHE_HIT;
+                evictions += result == CACHE_EVICT;
+                if (verbose) {
+                    printf(result == CACHE_HIT    ? " hit"
+                           : result == CACHE_MISS ? " miss"
+                                                  : " miss eviction");
+                }
+            }
+            if (verbose) {
+                printf("\n");
+            }
+        }
     }
 }
 
 /**
- * 6. Free cache
+ * 5. Free cache
  */
 void freeCache() {
-    fclose(fp);
-    for (int i = 0; i < S; i++) {
-        free(cache[i]);
+    closeTrace(&trace);
+    free(nextUse);
+    if (classify) {
+        classifierFree(&classifier);
+    }
+    hierarchyFree(&hier);
+    if (hier.prefetcher != NULL) {
+        prefetchFree(hier.prefetcher);
+    }
+    if (useTlb) {
+        tlbFree(&tlb);
+    }
+}
+
+/**
+ * 6. Print the miss breakdown
+ */
+void printClassification() {
+    printf("compulsory:%lu capacity:%lu conflict:%lu\n",
+           missKinds[MISS_COMPULSORY], missKinds[MISS_CAPACITY],
+           missKinds[MISS_CONFLICT]);
+    for (int i = 0; i < nRegions; i++) {
+        Region* r = &regions[i];
+        printf("region %s hits:%lu misses:%lu compulsory:%lu capacity:%lu "
+               "conflict:%lu\n",
+               r->name, r->hits,
+               r->misses[0] + r->misses[1] + r->misses[2],
+               r->misses[MISS_COMPULSORY], r->misses[MISS_CAPACITY],
+               r->misses[MISS_CONFLICT]);
     }
-    free(cache);
+    free(regions);
 }
 
 int main(int argc, char* argv[]) {
     getArgs(argc, argv);
+    if (protocol >= 0) {
+        simulateCores();
+        printSummary(hits, misses, evictions);
+        printCoherence(&coherence, 10);
+        coherenceFree(&coherence);
+        return 0;
+    }
     initCache();
+    if (hier.levels[0].policy == POLICY_OPT) {
+        planOptimal();
+    }
     simulate();
     freeCache();
     printSummary(hits, misses, evictions);
+    if (hier.prefetcher != NULL) {
+        printPrefetch(hier.prefetcher);
+    }
+    if (useTlb) {
+        printTlb(&tlb);
+    }
+    if (showLevels) {
+        printHierarchy(&hier);
+    }
+    if (classify) {
+        printClassification();
+    }
     return 0;
 }
\ No newline at end of file
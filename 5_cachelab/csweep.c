@@ -0,0 +1,255 @@
+/**
+ * csweep.c - Simulate many cache configurations over traces in one run
+ *
+ * Each trace is parsed once into an array of data addresses (a modify
+ * is a load and a store, as in csim). Every (trace, s, E, b) point is a
+ * job; worker threads take jobs from a shared counter and run them on
+ * the in-memory arrays, which they only read, so points run in parallel
+ * without any other synchronization. The results are written as CSV in
+ * job order.
+ *
+ * Usage: ./csweep [-h] [-j threads] [-s list] [-E list] [-b list]
+ *                 [-r policy] [-o file] <trace>...
+ */
+
+#define _DEFAULT_SOURCE
+#include <getopt.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "cachemodel.h"
+#include "tracefile.h"
+
+#define MAX_VALUES 64
+
+// the data addresses of one trace
+typedef struct {
+    const char* path;
+    unsigned long* addresses;
+    size_t n;
+} Trace;
+
+// one point of the sweep and its result
+typedef struct {
+    int trace, s, E, b;
+    unsigned long hits, misses, evictions;
+    int failed;  // the configuration was invalid
+} Job;
+
+Trace* traces;
+Job* jobs;
+unsigned nJobs;
+unsigned nextJob = 0;  // first job no worker has taken
+pthread_mutex_t jobLock = PTHREAD_MUTEX_INITIALIZER;
+int policy = POLICY_LRU;
+
+void printUsage() {
+    printf(
+        "Usage: ./csweep [-h] [-j threads] [-s list] [-E list] [-b list]\n"
+        "                [-r policy] [-o file] <trace>...\n"
+        "Options:\n"
+        "  -h         Print this help message.\n"
+        "  -j <num>   Worker threads (default: one per online CPU).\n"
+        "  -s <list>  Set index bits to try (default 0-10).\n"
+        "  -E <list>  Lines per set to try (default 1,2,4,8,16).\n"
+        "  -b <list>  Block offset bits to try (default 4-6).\n"
+        "  -r <policy> Replacement policy, as for csim (not opt).\n"
+        "  -o <file>  Write the CSV there instead of to stdout.\n"
+        "A list is comma-separated numbers and lo-hi ranges.\n\n"
+        "Examples:\n"
+        "  linux>  ./csweep -s 0-12 -E 1,2,4,8 -b 3-6 traces/*.trace\n");
+}
+
+/**
+ * Parse a list such as "1,2,4-6"
+ * @return the number of values, or -1 if the list is malformed
+ */
+int parseList(const char* text, int* values) {
+    int n = 0, lo, hi, len;
+
+    while (*text) {
+        if (sscanf(text, "%d-%d%n", &lo, &hi, &len) == 2) {
+            text += len;
+        } else if (sscanf(text, "%d%n", &lo, &len) == 1) {
+            hi = lo;
+            text += len;
+        } else {
+            return -1;
+        }
+        for (int v = lo; v <= hi; v++) {
+            if (n == MAX_VALUES) {
+                return -1;
+            }
+            values[n++] = v;
+        }
+        if (*text == ',') {
+            text++;
+        } else if (*text) {
+            return -1;
+        }
+    }
+    return n;
+}
+
+/**
+ * Simulate one point of the sweep
+ */
+void runJob(Job* job) {
+    const Trace* t = &traces[job->trace];
+    Cache cache;
+
+    if (cacheInit(&cache, job->s, job->E, job->b) < 0) {
+        job->failed = 1;
+        return;
+    }
+    if (cacheSetPolicy(&cache, policy, 1) < 0) {
+        cacheFree(&cache);
+        job->failed = 1;
+        return;
+    }
+    for (size_t i = 0; i < t->n; i++) {
+        switch (cacheAccess(&cache, t->addresses[i], 0, NULL)) {
+            case CACHE_HIT:
+                job->hits++;
+                break;
+            case CACHE_MISS:
+                job->misses++;
+                break;
+            default:
+                job->misses++;
+                job->evictions++;
+                break;
+        }
+    }
+    cacheFree(&cache);
+}
+
+/**
+ * Worker thread: run jobs until none are left
+ */
+void* worker(void* arg) {
+    while (1) {
+        unsigned i;
+        pthread_mutex_lock(&jobLock);
+        i = nextJob++;
+        pthread_mutex_unlock(&jobLock);
+        if (i >= nJobs) {
+            return NULL;
+        }
+        runJob(&jobs[i]);
+    }
+}
+
+int main(int argc, char* argv[]) {
+    int opt, nThreads = sysconf(_SC_NPROCESSORS_ONLN);
+    int sList[MAX_VALUES], EList[MAX_VALUES], bList[MAX_VALUES];
+    int nS = parseList("0-10", sList), nE = parseList("1,2,4,8,16", EList);
+    int nB = parseList("4-6", bList), nTraces;
+    FILE* out = stdout;
+    pthread_t* threads;
+
+    while ((opt = getopt(argc, argv, "hj:s:E:b:r:o:")) != -1) {
+        switch (opt) {
+            case 'j':
+                nThreads = atoi(optarg);
+                break;
+            case 's':
+                nS = parseList(optarg, sList);
+                break;
+            case 'E':
+                nE = parseList(optarg, EList);
+                break;
+            case 'b':
+                nB = parseList(optarg, bList);
+                break;
+            case 'r':
+                policy = parsePolicy(optarg);
+                break;
+            case 'o':
+                if ((out = fopen(optarg, "w")) == NULL) {
+                    perror(optarg);
+                    exit(-1);
+                }
+                break;
+            default:
+                printUsage();
+                exit(opt == 'h' ? 0 : -1);
+        }
+    }
+    if (nS <= 0 || nE <= 0 || nB <= 0 || policy < 0 ||
+        policy == POLICY_OPT || optind == argc) {
+        printUsage();
+        exit(-1);
+    }
+    if (nThreads < 1) {
+        nThreads = 1;
+    }
+
+    // parse every trace once
+    nTraces = argc - optind;
+    if ((traces = calloc(nTraces, sizeof(Trace))) == NULL) {
+        exit(-1);
+    }
+    for (int t = 0; t < nTraces; t++) {
+        traces[t].path = argv[optind + t];
+        if (loadTraceAddresses(traces[t].path, &traces[t].addresses,
+                               &traces[t].n) < 0) {
+            exit(-1);
+        }
+    }
+
+    // one job per trace and configuration
+    nJobs = (unsigned)nTraces * nS * nE * nB;
+    if ((jobs = calloc(nJobs, sizeof(Job))) == NULL) {
+        exit(-1);
+    }
+    for (unsigned i = 0; i < nJobs; i++) {
+        jobs[i].trace = i / (nS * nE * nB);
+        jobs[i].s = sList[i / (nE * nB) % nS];
+        jobs[i].E = EList[i / nB % nE];
+        jobs[i].b = bList[i % nB];
+    }
+
+    if ((threads = calloc(nThreads, sizeof(pthread_t))) == NULL) {
+        exit(-1);
+    }
+    for (int i = 0; i < nThreads; i++) {
+        if (pthread_create(&threads[i], NULL, worker, NULL) != 0) {
+            fprintf(stderr, "cannot create worker threads\n");
+            exit(-1);
+        }
+    }
+    for (int i = 0; i < nThreads; i++) {
+        pthread_join(threads[i], NULL);
+    }
+
+    fprintf(out, "trace,s,E,b,bytes,accesses,hits,misses,evictions,"
+                 "miss_rate\n");
+    for (unsigned i = 0; i < nJobs; i++) {
+        Job* job = &jobs[i];
+        const Trace* t = &traces[job->trace];
+        if (job->failed) {
+            fprintf(stderr, "%s: skipped invalid s=%d E=%d b=%d\n", t->path,
+                    job->s, job->E, job->b);
+            continue;
+        }
+        fprintf(out, "%s,%d,%d,%d,%lu,%zu,%lu,%lu,%lu,%.6f\n", t->path,
+                job->s, job->E, job->b,
+                (unsigned long)job->E << (job->s + job->b), t->n, job->hits,
+                job->misses, job->evictions,
+                t->n ? (double)job->misses / t->n : 0.0);
+    }
+    if (out != stdout && fclose(out) != 0) {
+        exit(-1);
+    }
+
+    for (int t = 0; t < nTraces; t++) {
+        free(traces[t].addresses);
+    }
+    free(traces);
+    free(jobs);
+    free(threads);
+    return 0;
+}
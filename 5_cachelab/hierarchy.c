@@ -0,0 +1,327 @@
+/**
+ * hierarchy.c - A multi-level cache hierarchy
+ *
+ * Each level is a cachemodel cache with its own geometry, replacement
+ * policy, write policy (write-back or write-through, write-allocate or
+ * not) and inclusion policy towards the levels above it. An access
+ * starts at level 1 and travels down as a request:
+ * - REQ_LOAD: a demand load, or a fill for a miss in the level above
+ * - REQ_STORE: a demand store, or a store passed on by a write-through
+ *   or no-write-allocate level above
+ * - REQ_WRITEBACK: a dirty line evicted from the level above
+ * - REQ_INSERT: a clean line evicted into an exclusive level
+ * Hits, misses and evictions count demand requests (loads and stores)
+ * only; writebacks count the dirty lines a level sends down.
+ *
+ * A prefetcher may watch level 1. Its lines are fetched from level 2 as
+ * loads, and either fill level 1 or go into its stream buffers; a level 1
+ * miss a stream buffer serves still counts as a miss, but is not fetched.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "hierarchy.h"
+
+#define REQ_LOAD 0
+#define REQ_STORE 1
+#define REQ_WRITEBACK 2
+#define REQ_INSERT 3
+
+static int accessLevel(Hierarchy* h, int i, unsigned long address, int req,
+                       int* gotDirty);
+
+/**
+ * Settings of a level before any options: LRU, write-back,
+ * write-allocate, non-inclusive
+ */
+void defaultLevel(Level* level) {
+    memset(level, 0, sizeof(*level));
+    level->s = level->E = level->b = -1;
+    level->policy = POLICY_LRU;
+    level->inclusion = INCL_NINE;
+    level->writeBack = 1;
+    level->writeAllocate = 1;
+}
+
+/**
+ * Apply a level description such as "s=8,E=8,b=6,incl,wb,wa,plru"
+ * @param spec comma-separated s=, E=, b= and policy keywords (modified)
+ * @return 0, or -1 for an unknown keyword
+ */
+int parseLevel(Level* level, char* spec) {
+    for (char* tok = strtok(spec, ","); tok; tok = strtok(NULL, ",")) {
+        if (!strncmp(tok, "s=", 2)) {
+            level->s = atoi(tok + 2);
+        } else if (!strncmp(tok, "E=", 2)) {
+            level->E = atoi(tok + 2);
+        } else if (!strncmp(tok, "b=", 2)) {
+            level->b = atoi(tok + 2);
+        } else if (!strcmp(tok, "incl")) {
+            level->inclusion = INCL_INCLUSIVE;
+        } else if (!strcmp(tok, "excl")) {
+            level->inclusion = INCL_EXCLUSIVE;
+        } else if (!strcmp(tok, "nine")) {
+            level->inclusion = INCL_NINE;
+        } else if (!strcmp(tok, "wb")) {
+            level->writeBack = 1;
+        } else if (!strcmp(tok, "wt")) {
+            level->writeBack = 0;
+        } else if (!strcmp(tok, "wa")) {
+            level->writeAllocate = 1;
+        } else if (!strcmp(tok, "nwa")) {
+            level->writeAllocate = 0;
+        } else if (parsePolicy(tok) >= 0) {
+            level->policy = parsePolicy(tok);
+        } else {
+            fprintf(stderr, "unknown cache level option: %s\n", tok);
+            return -1;
+        }
+    }
+    return 0;
+}
+
+/**
+ * Allocate the caches of all levels
+ * @return 0, or -1 (with a message) if a level is invalid
+ */
+int hierarchyInit(Hierarchy* h) {
+    for (int i = 0; i < h->n; i++) {
+        Level* level = &h->levels[i];
+        Level* above = i > 0 ? &h->levels[i - 1] : NULL;
+
+        if (above && level->b < above->b) {
+            fprintf(stderr, "L%d blocks are smaller than L%d's\n", i + 1, i);
+            return -1;
+        }
+        if (above && level->inclusion == INCL_EXCLUSIVE &&
+            level->b != above->b) {
+            fprintf(stderr, "exclusive L%d needs L%d's block size\n", i + 1,
+                    i);
+            return -1;
+        }
+        if (i > 0 && level->policy == POLICY_OPT) {
+            // the future is only known for the trace's own accesses
+            fprintf(stderr, "opt is only available for L1\n");
+            return -1;
+        }
+        if (cacheInit(&level->cache, level->s, level->E, level->b) < 0) {
+            fprintf(stderr, "cannot allocate L%d with s=%d E=%d b=%d\n",
+                    i + 1, level->s, level->E, level->b);
+            return -1;
+        }
+        if (cacheSetPolicy(&level->cache, level->policy, h->seed + i) < 0) {
+            fprintf(stderr, "L%d cannot use %s with E=%d\n", i + 1,
+                    policyNames[level->policy], level->E);
+            cacheFree(&level->cache);
+            return -1;
+        }
+    }
+    return 0;
+}
+
+/**
+ * Free the caches of all levels
+ */
+void hierarchyFree(Hierarchy* h) {
+    for (int i = 0; i < h->n; i++) {
+        cacheFree(&h->levels[i].cache);
+    }
+}
+
+/**
+ * Remove a block evicted from inclusive level i from every level above
+ * @return whether any of the removed copies was dirty
+ */
+static int backInvalidate(Hierarchy* h, int i, unsigned long address) {
+    unsigned long size = 1UL << h->levels[i].b;
+    int dirty = 0;
+
+    for (int j = 0; j < i; j++) {
+        unsigned long step = 1UL << h->levels[j].b;
+        for (unsigned long a = address; a < address + size; a += step) {
+            dirty |= cacheInvalidate(&h->levels[j].cache, a) == 1;
+        }
+    }
+    return dirty;
+}
+
+/**
+ * Send a line evicted from level i to where its policy says it goes
+ */
+static void evict(Hierarchy* h, int i, CacheVictim* victim) {
+    Level* level = &h->levels[i];
+    Level* below = i + 1 < h->n ? &h->levels[i + 1] : NULL;
+
+    if (i > 0 && level->inclusion == INCL_INCLUSIVE) {
+        victim->dirty |= backInvalidate(h, i, victim->address);
+    }
+    if (i == 0 && h->prefetcher != NULL) {
+        prefetchEvicted(h->prefetcher, victim->address);
+    }
+    if (victim->dirty) {
+        level->writebacks++;
+        accessLevel(h, i + 1, victim->address, REQ_WRITEBACK, NULL);
+    } else if (below && below->inclusion == INCL_EXCLUSIVE) {
+        accessLevel(h, i + 1, victim->address, REQ_INSERT, NULL);
+    }
+}
+
+/**
+ * Handle one request at level i (level n is memory)
+ * @param gotDirty if not NULL, set when a load takes a dirty line out of
+ *     an exclusive level
+ * @return the level's CACHE_* result
+ */
+static int accessLevel(Hierarchy* h, int i, unsigned long address, int req,
+                       int* gotDirty) {
+    Level* level;
+    CacheVictim victim;
+    int flags = 0, result, filled, dirty = 0, exclusive;
+
+    if (i == h->n) {
+        if (req == REQ_LOAD) {
+            h->memReads++;
+        } else if (req != REQ_INSERT) {
+            h->memWrites++;
+        }
+        return CACHE_MISS;
+    }
+    level = &h->levels[i];
+    exclusive = i > 0 && level->inclusion == INCL_EXCLUSIVE;
+
+    // an exclusive level is filled only by evictions from above
+    if ((req == REQ_STORE && !level->writeAllocate) ||
+        (exclusive && (req == REQ_LOAD || req == REQ_STORE))) {
+        flags |= CACHE_NOALLOC;
+    }
+    if (level->writeBack && (req == REQ_STORE || req == REQ_WRITEBACK)) {
+        flags |= CACHE_DIRTY;
+    }
+    result = cacheAccess(&level->cache, address, flags, &victim);
+    filled = result != CACHE_HIT && !(flags & CACHE_NOALLOC);
+
+    if (req == REQ_LOAD || req == REQ_STORE) {
+        if (result == CACHE_HIT) {
+            level->hits++;
+        } else {
+            level->misses++;
+        }
+        level->result = result;
+    }
+    if (result == CACHE_EVICT) {
+        level->evictions++;
+        evict(h, i, &victim);
+    }
+
+    if (result == CACHE_HIT) {
+        // the line moves up out of an exclusive level
+        if (exclusive && req == REQ_LOAD) {
+            dirty = cacheInvalidate(&level->cache, address) == 1;
+        }
+    } else if (i == 0 && filled && h->prefetcher != NULL &&
+               streamTake(h->prefetcher, address)) {
+        // a stream buffer had the line
+    } else if (req == REQ_LOAD || req == REQ_STORE ||
+               (req == REQ_WRITEBACK && level->b > h->levels[i - 1].b)) {
+        // fetch the block, or pass an unallocated request on
+        accessLevel(h, i + 1, address, filled ? REQ_LOAD : req, &dirty);
+        if (filled && dirty) {
+            cacheAccess(&level->cache, address, CACHE_DIRTY, NULL);
+            dirty = 0;
+        }
+    }
+    if (gotDirty != NULL) {
+        *gotDirty = dirty;
+    }
+
+    // write-through: stores and writebacks continue down
+    if (!level->writeBack && (req == REQ_STORE || req == REQ_WRITEBACK) &&
+        !(req == REQ_STORE && result != CACHE_HIT && !filled)) {
+        accessLevel(h, i + 1, address, req, NULL);
+    }
+    return result;
+}
+
+/**
+ * Bring a line into level 1 for the prefetcher, unless it is there
+ */
+static void prefetchLine(Hierarchy* h, unsigned long address) {
+    Level* level = &h->levels[0];
+    CacheVictim victim;
+    int dirty = 0;
+
+    if (cacheProbe(&level->cache, address)) {
+        return;
+    }
+    if (cacheAccess(&level->cache, address, 0, &victim) == CACHE_EVICT) {
+        level->evictions++;
+        evict(h, 0, &victim);
+    }
+    accessLevel(h, 1, address, REQ_LOAD, &dirty);
+    if (dirty) {
+        cacheAccess(&level->cache, address, CACHE_DIRTY, NULL);
+    }
+    prefetchFilled(h->prefetcher, address);
+}
+
+/**
+ * Simulate one load or store, then the prefetches it triggers
+ * @return the level 1 CACHE_* result
+ */
+int hierarchyAccess(Hierarchy* h, unsigned long address, int write) {
+    unsigned long lines[MAX_DEGREE];
+    int results[MAX_LEVELS];
+    int result, n;
+
+    for (int i = 0; i < h->n; i++) {
+        h->levels[i].result = -1;
+    }
+    result = accessLevel(h, 0, address, write ? REQ_STORE : REQ_LOAD, NULL);
+    if (h->prefetcher == NULL) {
+        return result;
+    }
+
+    // prefetches do not show in the verbose output of the demand access
+    for (int i = 0; i < h->n; i++) {
+        results[i] = h->levels[i].result;
+    }
+    n = prefetchTrain(h->prefetcher, address, result == CACHE_HIT, lines);
+    for (int k = 0; k < n; k++) {
+        if (h->prefetcher->kind == PF_STREAM) {
+            accessLevel(h, 1, lines[k], REQ_LOAD, NULL);
+        } else {
+            prefetchLine(h, lines[k]);
+        }
+    }
+    for (int i = 0; i < h->n; i++) {
+        h->levels[i].result = results[i];
+    }
+    return result;
+}
+
+/**
+ * Print what the last access did below level 1, for verbose output
+ */
+void printAccess(const Hierarchy* h) {
+    static const char* names[] = {"hit", "miss", "miss-eviction"};
+
+    for (int i = 1; i < h->n; i++) {
+        if (h->levels[i].result >= 0) {
+            printf(" L%d:%s", i + 1, names[h->levels[i].result]);
+        }
+    }
+}
+
+/**
+ * Print the statistics of every level and of memory
+ */
+void printHierarchy(const Hierarchy* h) {
+    for (int i = 0; i < h->n; i++) {
+        const Level* level = &h->levels[i];
+        printf("L%d hits:%lu misses:%lu evictions:%lu writebacks:%lu\n",
+               i + 1, level->hits, level->misses, level->evictions,
+               level->writebacks);
+    }
+    printf("memory reads:%lu writes:%lu\n", h->memReads, h->memWrites);
+}
@@ -0,0 +1,46 @@
+/**
+ * hierarchy.h - A multi-level cache hierarchy built from cachemodel caches
+ */
+
+#ifndef HIERARCHY_H
+#define HIERARCHY_H
+
+#include "cachemodel.h"
+#include "prefetch.h"
+
+#define MAX_LEVELS 4
+
+// how a level's contents relate to the levels above it
+#define INCL_NINE 0       // neither inclusive nor exclusive
+#define INCL_INCLUSIVE 1  // holds everything above; evictions back-invalidate
+#define INCL_EXCLUSIVE 2  // holds only what the level above evicted
+
+// one level of the hierarchy and its statistics
+typedef struct {
+    Cache cache;
+    int s, E, b;
+    int policy;         // POLICY_* replacement
+    int inclusion;      // INCL_*, ignored for level 1
+    int writeBack;      // 1: write-back, 0: write-through
+    int writeAllocate;  // fill the line on a store miss
+    unsigned long hits, misses, evictions, writebacks;
+    int result;  // CACHE_* of the last access's demand request, or -1
+} Level;
+
+typedef struct {
+    int n;  // number of levels
+    Level levels[MAX_LEVELS];
+    unsigned long memReads, memWrites;
+    unsigned long seed;  // for random replacement; level i uses seed + i
+    Prefetcher* prefetcher;  // feeds level 1, or NULL
+} Hierarchy;
+
+void defaultLevel(Level* level);
+int parseLevel(Level* level, char* spec);
+int hierarchyInit(Hierarchy* h);
+void hierarchyFree(Hierarchy* h);
+int hierarchyAccess(Hierarchy* h, unsigned long address, int write);
+void printAccess(const Hierarchy* h);
+void printHierarchy(const Hierarchy* h);
+
+#endif /* HIERARCHY_H */
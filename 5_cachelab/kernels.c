@@ -0,0 +1,214 @@
+/*
+ * kernels.c - Matrix multiply and stencil kernels for the cache lab
+ *     harness
+ *
+ * Each kernel has a prototype of the form:
+ * void kernel(int M, int N, int A[N][M], int B[M][N], int C[N][N]);
+ *
+ * and is registered with registerKernel, along with the baseline from
+ * cachelab.c that its results are checked against. ./test-trans -k and
+ * ./tracegen -k evaluate these kernels instead of the transposes, with
+ * the same marker-bounded traces and miss counts.
+ *
+ * A matrix multiply sets C = A B, N x M times M x N. A stencil reads A
+ * as a grid of N rows of M and writes the result to the same shape in
+ * B's memory.
+ *
+ * The drivers place A, B and C a multiple of the graded cache's size
+ * apart, as they do A and B for the transposes, so that the same tile of
+ * each maps to the same sets; and rows of 256 ints are the whole cache,
+ * so the rows of one tile do too. The tiles below fit by size, but at
+ * such shapes these conflicts can cost more than they save.
+ */
+#include "cachelab.h"
+#include "contracts.h"
+
+/* Tiles of the blocked multiply: one line of ints a side */
+#define MM_TILE 8
+
+/* Sub-problems at most this many elements in each dimension are not
+   split further */
+#define MM_REC_BASE 8
+
+/*
+ * matmul_naive - Dot product of each row of A with each column of B,
+ *     walking down B's columns
+ */
+char matmul_naive_desc[] = "Matrix multiply, naive ijk";
+void matmul_naive(int M, int N, int A[N][M], int B[M][N], int C[N][N])
+{
+    int i, j, k, sum;
+
+    REQUIRES(M > 0);
+    REQUIRES(N > 0);
+
+    for (i = 0; i < N; i++) {
+        for (j = 0; j < N; j++) {
+            sum = 0;
+            for (k = 0; k < M; k++) {
+                sum += A[i][k] * B[k][j];
+            }
+            C[i][j] = sum;
+        }
+    }
+}
+
+/*
+ * mm_zero - Clear C before products are added to it. This is a loop
+ *     rather than memset, whose stores the tracer would not see.
+ */
+static void mm_zero(int N, int C[N][N])
+{
+    int i, j;
+
+    for (i = 0; i < N; i++) {
+        for (j = 0; j < N; j++) {
+            C[i][j] = 0;
+        }
+    }
+}
+
+/*
+ * mm_tile - Add the product of rows i0..i1-1 and columns k0..k1-1 of A
+ *     with rows k0..k1-1 and columns j0..j1-1 of B to C, in ikj order
+ *     so that B and C are read along their rows
+ */
+static void mm_tile(int M, int N, int A[N][M], int B[M][N], int C[N][N],
+                    int i0, int i1, int j0, int j1, int k0, int k1)
+{
+    int i, j, k, a;
+
+    for (i = i0; i < i1; i++) {
+        for (k = k0; k < k1; k++) {
+            a = A[i][k];
+            for (j = j0; j < j1; j++) {
+                C[i][j] += a * B[k][j];
+            }
+        }
+    }
+}
+
+/*
+ * matmul_blocked - Multiply in MM_TILE x MM_TILE tiles, so that a tile
+ *     of each matrix is reused while it is cached
+ */
+char matmul_blocked_desc[] = "Matrix multiply, blocked";
+void matmul_blocked(int M, int N, int A[N][M], int B[M][N], int C[N][N])
+{
+    int i, j, k;
+
+    REQUIRES(M > 0);
+    REQUIRES(N > 0);
+
+    mm_zero(N, C);
+    for (i = 0; i < N; i += MM_TILE) {
+        for (k = 0; k < M; k += MM_TILE) {
+            for (j = 0; j < N; j += MM_TILE) {
+                mm_tile(M, N, A, B, C, i, i + MM_TILE < N ? i + MM_TILE : N,
+                        j, j + MM_TILE < N ? j + MM_TILE : N,
+                        k, k + MM_TILE < M ? k + MM_TILE : M);
+            }
+        }
+    }
+}
+
+/*
+ * mm_rec - Multiply rows i0..i1-1 of A by columns j0..j1-1 of B over
+ *     k0..k1-1, halving the largest of the three ranges until the
+ *     sub-problem is small
+ */
+static void mm_rec(int M, int N, int A[N][M], int B[M][N], int C[N][N],
+                   int i0, int i1, int j0, int j1, int k0, int k1)
+{
+    int di = i1 - i0, dj = j1 - j0, dk = k1 - k0, mid;
+
+    if (di <= MM_REC_BASE && dj <= MM_REC_BASE && dk <= MM_REC_BASE) {
+        mm_tile(M, N, A, B, C, i0, i1, j0, j1, k0, k1);
+    } else if (di >= dj && di >= dk) {
+        mid = i0 + di / 2;
+        mm_rec(M, N, A, B, C, i0, mid, j0, j1, k0, k1);
+        mm_rec(M, N, A, B, C, mid, i1, j0, j1, k0, k1);
+    } else if (dj >= dk) {
+        mid = j0 + dj / 2;
+        mm_rec(M, N, A, B, C, i0, i1, j0, mid, k0, k1);
+        mm_rec(M, N, A, B, C, i0, i1, mid, j1, k0, k1);
+    } else {
+        mid = k0 + dk / 2;
+        mm_rec(M, N, A, B, C, i0, i1, j0, j1, k0, mid);
+        mm_rec(M, N, A, B, C, i0, i1, j0, j1, mid, k1);
+    }
+}
+
+/*
+ * matmul_recursive - Cache-oblivious multiply: the recursion reaches
+ *     sub-problems that fit whatever the cache
+ */
+char matmul_recursive_desc[] = "Matrix multiply, recursive cache-oblivious";
+void matmul_recursive(int M, int N, int A[N][M], int B[M][N], int C[N][N])
+{
+    REQUIRES(M > 0);
+    REQUIRES(N > 0);
+
+    mm_zero(N, C);
+    mm_rec(M, N, A, B, C, 0, N, 0, N, 0, M);
+}
+
+/*
+ * stencil_point - The 5-point stencil at row i, column j of A: the sum
+ *     of the point and its four neighbours, or the point alone on the
+ *     border
+ */
+static int stencil_point(int M, int N, int A[N][M], int i, int j)
+{
+    if (i == 0 || j == 0 || i == N - 1 || j == M - 1) {
+        return A[i][j];
+    }
+    return A[i][j] + A[i - 1][j] + A[i + 1][j] + A[i][j - 1] + A[i][j + 1];
+}
+
+/*
+ * stencil_rows - 5-point stencil a row at a time: each row of A is
+ *     read for three rows of output
+ */
+char stencil_rows_desc[] = "5-point stencil, by rows";
+void stencil_rows(int M, int N, int A[N][M], int B[M][N], int C[N][N])
+{
+    int (*out)[M] = (int (*)[M])B;
+    int i, j;
+
+    for (i = 0; i < N; i++) {
+        for (j = 0; j < M; j++) {
+            out[i][j] = stencil_point(M, N, A, i, j);
+        }
+    }
+}
+
+/*
+ * stencil_cols - 5-point stencil a column at a time, across the lines
+ *     of A and of the output
+ */
+char stencil_cols_desc[] = "5-point stencil, by columns";
+void stencil_cols(int M, int N, int A[N][M], int B[M][N], int C[N][N])
+{
+    int (*out)[M] = (int (*)[M])B;
+    int i, j;
+
+    for (j = 0; j < M; j++) {
+        for (i = 0; i < N; i++) {
+            out[i][j] = stencil_point(M, N, A, i, j);
+        }
+    }
+}
+
+/*
+ * registerKernels - Register the kernels with the driver, each with the
+ *     baseline its results must match
+ */
+void registerKernels()
+{
+    registerKernel(matmul_naive, correctMatmul, matmul_naive_desc);
+    registerKernel(matmul_blocked, correctMatmul, matmul_blocked_desc);
+    registerKernel(matmul_recursive, correctMatmul, matmul_recursive_desc);
+    registerKernel(stencil_rows, correctStencil, stencil_rows_desc);
+    registerKernel(stencil_cols, correctStencil, stencil_cols_desc);
+}
@@ -0,0 +1,313 @@
+/**
+ * prefetch.c - Hardware prefetcher models for the level 1 cache
+ *
+ * The prefetcher watches the demand accesses to level 1 and proposes
+ * lines to bring in ahead of use:
+ * - next: the next degree lines after a miss, or after the first use of
+ *   a prefetched line (tagged next-line prefetching)
+ * - stride: a table of the last address and stride seen in each recently
+ *   used 4 KB region. Traces carry no program counter, so the region
+ *   stands in for the load instruction. Once a stride repeats, the next
+ *   degree lines along it are prefetched.
+ * - stream: Jouppi stream buffers. A miss no buffer can serve restarts
+ *   the least recently used buffer at the next line; a miss a buffer can
+ *   serve takes the line from its head, and the buffer fetches one more.
+ *   Buffers sit beside the cache, so their lines do not pollute it.
+ *
+ * Time is counted in demand accesses: a prefetch issued at access t
+ * arrives at t + latency. A prefetched line used after it arrives is
+ * useful, one used before is late (it saved only part of the miss), and
+ * one evicted or discarded unused is useless.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "prefetch.h"
+
+#define REGION_BITS 12  // stride detector region: 4 KB
+
+const char* prefetchNames[3] = {"next", "stride", "stream"};
+
+/**
+ * Set up a prefetcher from its spec, kind[,degree=N][,latency=N][,streams=N]
+ * @param b log2 of the level 1 line size
+ * @return 0, or -1 if the spec is invalid or out of memory
+ */
+int prefetchInit(Prefetcher* pf, char* spec, int b) {
+    char* field;
+    int kind = -1;
+
+    memset(pf, 0, sizeof(*pf));
+    field = strtok(spec, ",");
+    for (int k = 0; field != NULL && k < 3; k++) {
+        if (strcmp(field, prefetchNames[k]) == 0) {
+            kind = k;
+        }
+    }
+    if (kind < 0) {
+        fprintf(stderr, "unknown prefetcher: %s\n", field ? field : "");
+        return -1;
+    }
+    pf->kind = kind;
+    pf->degree = kind == PF_STREAM ? 4 : 1;
+    pf->latency = 10;
+    pf->nStreams = 4;
+    pf->b = b;
+
+    while ((field = strtok(NULL, ",")) != NULL) {
+        char* value = strchr(field, '=');
+        int n;
+        if (value == NULL) {
+            fprintf(stderr, "bad prefetcher option: %s\n", field);
+            return -1;
+        }
+        *value++ = '\0';
+        n = atoi(value);
+        if (strcmp(field, "degree") == 0 && n >= 1 && n <= MAX_DEGREE) {
+            pf->degree = n;
+        } else if (strcmp(field, "latency") == 0 && n >= 0) {
+            pf->latency = n;
+        } else if (strcmp(field, "streams") == 0 && n >= 1 &&
+                   n <= MAX_STREAMS) {
+            pf->nStreams = n;
+        } else {
+            fprintf(stderr, "bad prefetcher option: %s=%s\n", field,
+                    value);
+            return -1;
+        }
+    }
+    return blockMapInit(&pf->pending);
+}
+
+/**
+ * Free a prefetcher's tables
+ */
+void prefetchFree(Prefetcher* pf) {
+    blockMapFree(&pf->pending);
+}
+
+/**
+ * Account for a demand access to a line the prefetcher brought into the
+ * cache, if it did
+ * @return 1 if this is the first use of a prefetched line
+ */
+static int usePending(Prefetcher* pf, unsigned long block, int hit) {
+    unsigned long* arrival = blockMapFind(&pf->pending, block);
+
+    if (arrival == NULL || *arrival == 0) {
+        return 0;
+    }
+    if (!hit) {
+        pf->useless++;  // replaced before it was used
+    } else if (pf->now + 1 >= *arrival) {
+        pf->useful++;
+    } else {
+        pf->late++;
+    }
+    *arrival = 0;
+    return hit;
+}
+
+/**
+ * Fetch lines into a stream buffer until it is full
+ */
+static void fillStream(Prefetcher* pf, StreamBuffer* buf) {
+    while (buf->count < pf->degree && pf->queued < MAX_DEGREE) {
+        buf->blocks[buf->count] = buf->next;
+        buf->ready[buf->count] = pf->now + pf->latency;
+        buf->count++;
+        pf->queue[pf->queued++] = buf->next++ << pf->b;
+        pf->issued++;
+    }
+}
+
+/**
+ * Restart the least recently used stream buffer after a missing block
+ */
+static void allocateStream(Prefetcher* pf, unsigned long block) {
+    StreamBuffer* buf = &pf->streams[0];
+
+    for (int i = 1; i < pf->nStreams; i++) {
+        if (pf->streams[i].lastUse < buf->lastUse) {
+            buf = &pf->streams[i];
+        }
+    }
+    pf->useless += buf->count;
+    buf->count = 0;
+    buf->next = block + 1;
+    buf->lastUse = pf->now;
+    fillStream(pf, buf);
+}
+
+/**
+ * Train the stride detector on an access
+ * @return the number of lines to prefetch, stored in lines
+ */
+static int trainStride(Prefetcher* pf, unsigned long address,
+                       unsigned long* lines) {
+    unsigned long region = address >> REGION_BITS;
+    unsigned long block = address >> pf->b;
+    StrideEntry* e = &pf->strides[region % STRIDE_ENTRIES];
+    long stride;
+    int n = 0;
+
+    // region + 1, so that a zeroed entry matches nothing
+    if (e->region != region + 1) {
+        StrideEntry* from = NULL;
+
+        // a stride walking out of a neighbouring region carries on here
+        for (int d = -1; d <= 1; d += 2) {
+            StrideEntry* nb = &pf->strides[(region + d) % STRIDE_ENTRIES];
+            if (nb->region == region + d + 1 && nb->confidence >= 1 &&
+                nb->last + nb->stride == address) {
+                from = nb;
+            }
+        }
+        if (from == NULL) {
+            e->region = region + 1;
+            e->last = address;
+            e->stride = 0;
+            e->confidence = 0;
+            return 0;
+        }
+        *e = *from;
+        e->region = region + 1;
+    }
+    stride = (long)(address - e->last);
+    if (stride == 0) {
+        return 0;
+    }
+    if (stride == e->stride) {
+        if (e->confidence < 3) {
+            e->confidence++;
+        }
+    } else {
+        e->stride = stride;
+        e->confidence = 0;
+    }
+    e->last = address;
+    if (e->confidence < 1) {
+        return 0;
+    }
+
+    // strides shorter than a line walk the lines next to this one
+    if (labs(stride) < (1L << pf->b)) {
+        for (int k = 1; k <= pf->degree; k++) {
+            lines[n++] = (stride > 0 ? block + k : block - k) << pf->b;
+        }
+    } else {
+        for (int k = 1; k <= pf->degree; k++) {
+            lines[n++] = address + k * stride;
+        }
+    }
+    return n;
+}
+
+/**
+ * Observe a demand access to level 1 and choose what to prefetch
+ * @param hit whether level 1 held the line
+ * @param lines filled with up to MAX_DEGREE addresses: lines to prefetch
+ *     into level 1, or for stream buffers the lines they now fetch
+ * @return the number of lines
+ */
+int prefetchTrain(Prefetcher* pf, unsigned long address, int hit,
+                  unsigned long* lines) {
+    unsigned long block = address >> pf->b;
+    int n = 0;
+
+    switch (pf->kind) {
+        case PF_NEXTLINE:
+            if (usePending(pf, block, hit) || !hit) {
+                for (int k = 1; k <= pf->degree; k++) {
+                    lines[n++] = (block + k) << pf->b;
+                }
+            }
+            break;
+        case PF_STRIDE:
+            usePending(pf, block, hit);
+            n = trainStride(pf, address, lines);
+            break;
+        case PF_STREAM:
+            if (!hit && !pf->taken) {
+                allocateStream(pf, block);
+            }
+            memcpy(lines, pf->queue, pf->queued * sizeof(*lines));
+            n = pf->queued;
+            pf->queued = 0;
+            break;
+    }
+    pf->taken = 0;
+    pf->now++;
+    return n;
+}
+
+/**
+ * Note that a prefetch has filled a level 1 line
+ */
+void prefetchFilled(Prefetcher* pf, unsigned long address) {
+    unsigned long* arrival = blockMapGet(&pf->pending, address >> pf->b, NULL);
+
+    if (arrival != NULL) {
+        *arrival = pf->now + pf->latency + 1;
+    }
+    pf->issued++;
+}
+
+/**
+ * Note that level 1 has evicted a line, which may have been prefetched
+ */
+void prefetchEvicted(Prefetcher* pf, unsigned long address) {
+    unsigned long* arrival = blockMapFind(&pf->pending, address >> pf->b);
+
+    if (arrival != NULL && *arrival != 0) {
+        pf->useless++;
+        *arrival = 0;
+    }
+}
+
+/**
+ * Serve a level 1 miss from the stream buffers, if one holds the line.
+ * Lines ahead of it in the buffer are discarded.
+ * @return 1 if a buffer supplied the line, so it need not be fetched
+ */
+int streamTake(Prefetcher* pf, unsigned long address) {
+    unsigned long block = address >> pf->b;
+
+    if (pf->kind != PF_STREAM) {
+        return 0;
+    }
+    for (int i = 0; i < pf->nStreams; i++) {
+        StreamBuffer* buf = &pf->streams[i];
+        for (int k = 0; k < buf->count; k++) {
+            if (buf->blocks[k] != block) {
+                continue;
+            }
+            pf->useless += k;
+            if (pf->now >= buf->ready[k]) {
+                pf->useful++;
+            } else {
+                pf->late++;
+            }
+            buf->count -= k + 1;
+            memmove(buf->blocks, buf->blocks + k + 1,
+                    buf->count * sizeof(*buf->blocks));
+            memmove(buf->ready, buf->ready + k + 1,
+                    buf->count * sizeof(*buf->ready));
+            buf->lastUse = pf->now;
+            fillStream(pf, buf);
+            pf->taken = 1;
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/**
+ * Print how many prefetches were issued and what became of them
+ */
+void printPrefetch(const Prefetcher* pf) {
+    printf("prefetch %s issued:%lu useful:%lu late:%lu useless:%lu\n",
+           prefetchNames[pf->kind], pf->issued, pf->useful, pf->late,
+           pf->useless);
+}
@@ -0,0 +1,61 @@
+/**
+ * prefetch.h - Hardware prefetcher models for the level 1 cache
+ */
+
+#ifndef PREFETCH_H
+#define PREFETCH_H
+
+#include "blockmap.h"
+
+#define PF_NEXTLINE 0  // the lines after a miss
+#define PF_STRIDE 1    // constant strides within 4 KB regions
+#define PF_STREAM 2    // Jouppi stream buffers beside the cache
+
+#define MAX_DEGREE 16        // lines fetched ahead, and stream depth
+#define STRIDE_ENTRIES 64    // stride detector table
+#define MAX_STREAMS 16
+
+// stride detector entry: one per recently used 4 KB region
+typedef struct {
+    unsigned long region, last;
+    long stride;
+    int confidence;
+} StrideEntry;
+
+// stream buffer: a FIFO of lines following an earlier miss
+typedef struct {
+    unsigned long blocks[MAX_DEGREE];
+    unsigned long ready[MAX_DEGREE];  // access count when each arrives
+    int count;
+    unsigned long next;      // next block to fetch into the buffer
+    unsigned long lastUse;
+} StreamBuffer;
+
+typedef struct {
+    int kind;
+    int degree;    // lines ahead (stream buffer depth)
+    int latency;   // demand accesses a prefetch takes to arrive
+    int nStreams;
+    int b;
+    unsigned long now;  // demand accesses so far
+    BlockMap pending;   // prefetched block -> arrival + 1, until first use
+    StrideEntry strides[STRIDE_ENTRIES];
+    StreamBuffer streams[MAX_STREAMS];
+    int taken;          // the current miss came from a stream buffer
+    unsigned long queue[MAX_DEGREE];  // stream lines to fetch
+    int queued;
+    unsigned long issued, useful, late, useless;
+} Prefetcher;
+
+extern const char* prefetchNames[3];
+
+int prefetchInit(Prefetcher* pf, char* spec, int b);
+void prefetchFree(Prefetcher* pf);
+int prefetchTrain(Prefetcher* pf, unsigned long address, int hit,
+                  unsigned long* lines);
+void prefetchFilled(Prefetcher* pf, unsigned long address);
+void prefetchEvicted(Prefetcher* pf, unsigned long address);
+int streamTake(Prefetcher* pf, unsigned long address);
+void printPrefetch(const Prefetcher* pf);
+
+#endif /* PREFETCH_H */
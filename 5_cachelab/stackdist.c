@@ -0,0 +1,179 @@
+/**
+ * stackdist.c - LRU miss-ratio curves for every associativity from one
+ * pass over a trace per set count
+ *
+ * An LRU cache of E lines per set hits exactly the accesses whose stack
+ * distance within their set (the number of distinct other blocks of the
+ * set used since the block's previous access) is below E. So one
+ * histogram of stack distances gives the misses of every E at once.
+ *
+ * Distances are counted with Olken's method. Each set has its own
+ * timeline of accesses, and a Fenwick tree over it holds a 1 at the
+ * last access of every block. The distance of an access is the sum of
+ * the tree between the block's previous access and now, which takes
+ * O(log N) time. The previous access of each block comes from a
+ * blockmap. The trees of all sets share one array of one counter per
+ * access.
+ *
+ * Usage: ./stackdist [-h] [-s lo-hi] [-b bits] [-E max] [-a] <trace>
+ */
+
+#include <getopt.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "blockmap.h"
+#include "tracefile.h"
+
+unsigned long* addresses;
+size_t n;
+
+void printUsage() {
+    printf(
+        "Usage: ./stackdist [-h] [-s lo-hi] [-b bits] [-E max] [-a] <trace>\n"
+        "Options:\n"
+        "  -h         Print this help message.\n"
+        "  -s <lo-hi> Set index bits to profile (default 0-10; 0 is fully\n"
+        "             associative).\n"
+        "  -b <num>   Block offset bits (default 4).\n"
+        "  -E <num>   Largest number of lines per set (default 65536).\n"
+        "  -a         Print every E up to the largest, not just powers of\n"
+        "             two.\n\n"
+        "Examples:\n"
+        "  linux>  ./stackdist -s 0-6 -b 5 traces/trans.trace\n");
+}
+
+/**
+ * Add delta at position i (0-based) of a Fenwick tree
+ */
+static void fenwickAdd(uint32_t* tree, size_t size, size_t i, int delta) {
+    for (i++; i <= size; i += i & -i) {
+        tree[i - 1] += delta;
+    }
+}
+
+/**
+ * Sum of positions 0..i-1 of a Fenwick tree
+ */
+static unsigned long fenwickSum(const uint32_t* tree, size_t i) {
+    unsigned long sum = 0;
+
+    for (; i > 0; i -= i & -i) {
+        sum += tree[i - 1];
+    }
+    return sum;
+}
+
+/**
+ * Histogram the per-set stack distances of the trace for 2^s sets
+ * @param hist maxE + 1 buckets: distances 0..maxE-1, then maxE and
+ *     beyond together with first references
+ */
+void profile(int s, int b, unsigned long maxE, unsigned long* hist) {
+    size_t S = 1UL << s;
+    size_t* base = calloc(S + 1, sizeof(size_t));  // each set's slice
+    size_t* now = calloc(S, sizeof(size_t));       // each set's clock
+    uint32_t* tree = calloc(n ? n : 1, sizeof(uint32_t));
+    BlockMap last;  // block -> its set's clock at its last access + 1
+
+    if (base == NULL || now == NULL || tree == NULL ||
+        blockMapInit(&last) < 0) {
+        fprintf(stderr, "out of memory\n");
+        exit(-1);
+    }
+    memset(hist, 0, (maxE + 1) * sizeof(unsigned long));
+
+    // slice the tree array by the number of accesses to each set
+    for (size_t i = 0; i < n; i++) {
+        base[((addresses[i] >> b) & (S - 1)) + 1]++;
+    }
+    for (size_t set = 0; set < S; set++) {
+        base[set + 1] += base[set];
+    }
+
+    for (size_t i = 0; i < n; i++) {
+        unsigned long block = addresses[i] >> b;
+        size_t set = block & (S - 1);
+        uint32_t* setTree = tree + base[set];
+        size_t size = base[set + 1] - base[set];
+        size_t t = now[set]++;
+        unsigned long* prev = blockMapGet(&last, block, NULL);
+
+        if (prev == NULL) {
+            fprintf(stderr, "out of memory\n");
+            exit(-1);
+        }
+        if (*prev) {
+            unsigned long d =
+                fenwickSum(setTree, t) - fenwickSum(setTree, *prev);
+            hist[d < maxE ? d : maxE]++;
+            fenwickAdd(setTree, size, *prev - 1, -1);
+        } else {
+            hist[maxE]++;
+        }
+        fenwickAdd(setTree, size, t, 1);
+        *prev = t + 1;
+    }
+    blockMapFree(&last);
+    free(base);
+    free(now);
+    free(tree);
+}
+
+int main(int argc, char* argv[]) {
+    int opt, sLo = 0, sHi = 10, b = 4, all = 0;
+    unsigned long maxE = 65536;
+    unsigned long* hist;
+
+    while ((opt = getopt(argc, argv, "hs:b:E:a")) != -1) {
+        switch (opt) {
+            case 's':
+                if (sscanf(optarg, "%d-%d", &sLo, &sHi) == 1) {
+                    sHi = sLo;
+                }
+                break;
+            case 'b':
+                b = atoi(optarg);
+                break;
+            case 'E':
+                maxE = strtoul(optarg, NULL, 0);
+                break;
+            case 'a':
+                all = 1;
+                break;
+            default:
+                printUsage();
+                exit(opt == 'h' ? 0 : -1);
+        }
+    }
+    if (optind != argc - 1 || sLo < 0 || sHi < sLo || b < 0 ||
+        sHi + b >= 64 || maxE < 1) {
+        printUsage();
+        exit(-1);
+    }
+    if (loadTraceAddresses(argv[optind], &addresses, &n) < 0) {
+        exit(-1);
+    }
+    if ((hist = malloc((maxE + 1) * sizeof(unsigned long))) == NULL) {
+        exit(-1);
+    }
+
+    printf("s,E,b,bytes,accesses,misses,miss_rate\n");
+    for (int s = sLo; s <= sHi; s++) {
+        unsigned long misses = n;
+        profile(s, b, maxE, hist);
+        // E lines per set hit every distance below E
+        for (unsigned long E = 1; E <= maxE; E++) {
+            misses -= hist[E - 1];
+            if (all || !(E & (E - 1))) {
+                printf("%d,%lu,%d,%lu,%zu,%lu,%.6f\n", s, E, b,
+                       E << (s + b), n, misses,
+                       n ? (double)misses / n : 0.0);
+            }
+        }
+    }
+    free(hist);
+    free(addresses);
+    return 0;
+}
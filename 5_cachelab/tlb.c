@@ -0,0 +1,175 @@
+/**
+ * tlb.c - A two-level TLB and page walker, built from cachemodel caches
+ *
+ * The DTLB and the STLB are caches whose "lines" are pages, so the
+ * cachemodel replacement and set indexing apply unchanged. A translation
+ * looks in the DTLB, then the STLB, filling each on a miss; missing both
+ * walks the page tables.
+ *
+ * The page tables are x86-64 4-level paging over a 48-bit address space:
+ * PML4, PDPT, PD and PT, 512 8-byte entries a table. A 2 MB page ends the
+ * walk at the PD. A small fully associative page walk cache holds the
+ * entries that point at leaf tables, so a walk that hits it reads only
+ * the leaf entry. The tables are laid out at made-up addresses above user
+ * space, one region per level, so that when the walk loads go through the
+ * data caches (the walk option) neighbouring pages share table lines as
+ * they would in a real process.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "tlb.h"
+
+#define VA_BITS 48
+#define LEVEL_BITS 9                     // 512 entries a table
+#define PT_BASE 0xffff800000000000UL     // page tables, 2^40 bytes a level
+
+/**
+ * log2 of n, or -1 if n is not a power of two
+ */
+static int exactLog2(int n) {
+    int k = 0;
+
+    if (n <= 0 || (n & (n - 1))) {
+        return -1;
+    }
+    while ((1 << k) < n) {
+        k++;
+    }
+    return k;
+}
+
+/**
+ * Parse "<sets>x<ways>"
+ * @return 0, or -1 if it is malformed
+ */
+static int parseGeometry(const char* text, int* sets, int* ways) {
+    if (sscanf(text, "%dx%d", sets, ways) != 2 || exactLog2(*sets) < 0 ||
+        *ways <= 0) {
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * Set up a TLB from its spec:
+ * page=4k|2m, dtlb=<sets>x<ways>, stlb=<sets>x<ways>|none, pwc=<entries>
+ * and walk, comma-separated, all optional
+ * @return 0, or -1 (with a message) if the spec is invalid or out of memory
+ */
+int tlbInit(Tlb* t, char* spec) {
+    memset(t, 0, sizeof(*t));
+    t->pageBits = 12;
+    t->hasStlb = 1;
+    t->pwcEntries = 32;
+
+    for (char* tok = strtok(spec, ","); tok; tok = strtok(NULL, ",")) {
+        int bad = 0;
+        if (!strcmp(tok, "page=4k")) {
+            t->pageBits = 12;
+        } else if (!strcmp(tok, "page=2m")) {
+            t->pageBits = 21;
+        } else if (!strncmp(tok, "dtlb=", 5)) {
+            bad = parseGeometry(tok + 5, &t->dtlbSets, &t->dtlbWays);
+        } else if (!strcmp(tok, "stlb=none")) {
+            t->hasStlb = 0;
+        } else if (!strncmp(tok, "stlb=", 5)) {
+            bad = parseGeometry(tok + 5, &t->stlbSets, &t->stlbWays);
+        } else if (!strncmp(tok, "pwc=", 4)) {
+            t->pwcEntries = atoi(tok + 4);
+            bad = t->pwcEntries < 0;
+        } else if (!strcmp(tok, "walk")) {
+            t->walkCaches = 1;
+        } else {
+            bad = 1;
+        }
+        if (bad) {
+            fprintf(stderr, "bad TLB option: %s\n", tok);
+            return -1;
+        }
+    }
+
+    // Skylake-like defaults: 64 or 32 DTLB entries, 1536 STLB entries
+    if (t->dtlbSets == 0) {
+        t->dtlbSets = t->pageBits == 12 ? 16 : 8;
+        t->dtlbWays = 4;
+    }
+    if (t->stlbSets == 0) {
+        t->stlbSets = 128;
+        t->stlbWays = 12;
+    }
+    t->walkLevels = (VA_BITS - t->pageBits) / LEVEL_BITS;
+
+    if (cacheInit(&t->dtlb, exactLog2(t->dtlbSets), t->dtlbWays,
+                  t->pageBits) < 0 ||
+        (t->hasStlb && cacheInit(&t->stlb, exactLog2(t->stlbSets),
+                                 t->stlbWays, t->pageBits) < 0) ||
+        (t->pwcEntries > 0 &&
+         cacheInit(&t->pwc, 0, t->pwcEntries, t->pageBits + LEVEL_BITS) < 0)) {
+        fprintf(stderr, "out of memory for the TLB\n");
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * Free a TLB's caches
+ */
+void tlbFree(Tlb* t) {
+    cacheFree(&t->dtlb);
+    if (t->hasStlb) {
+        cacheFree(&t->stlb);
+    }
+    if (t->pwcEntries > 0) {
+        cacheFree(&t->pwc);
+    }
+}
+
+/**
+ * Translate the address of one access
+ * @param refs filled with the page table entries a walk reads, up to
+ *     MAX_WALK of them
+ * @param nRefs set to how many
+ * @return TLB_HIT, TLB_STLB or TLB_WALK
+ */
+int tlbAccess(Tlb* t, unsigned long address, unsigned long* refs,
+              int* nRefs) {
+    unsigned long va = address & ((1UL << VA_BITS) - 1);
+    int first = 0;
+
+    *nRefs = 0;
+    t->accesses++;
+    if (cacheAccess(&t->dtlb, address, 0, NULL) == CACHE_HIT) {
+        return TLB_HIT;
+    }
+    t->dtlbMisses++;
+    if (t->hasStlb && cacheAccess(&t->stlb, address, 0, NULL) == CACHE_HIT) {
+        return TLB_STLB;
+    }
+
+    // walk from the root, or from the leaf table if the PWC knows it
+    t->walks++;
+    if (t->pwcEntries > 0 &&
+        cacheAccess(&t->pwc, address, 0, NULL) == CACHE_HIT) {
+        t->pwcHits++;
+        first = t->walkLevels - 1;
+    }
+    for (int l = first; l < t->walkLevels; l++) {
+        int shift = t->pageBits + LEVEL_BITS * (t->walkLevels - 1 - l);
+        refs[(*nRefs)++] =
+            PT_BASE + ((unsigned long)l << 40) + (va >> shift) * 8;
+    }
+    t->walkRefs += *nRefs;
+    return TLB_WALK;
+}
+
+/**
+ * Print the TLB statistics
+ */
+void printTlb(const Tlb* t) {
+    printf("tlb page:%s accesses:%lu dtlb-misses:%lu walks:%lu "
+           "walk-loads:%lu pwc-hits:%lu\n",
+           t->pageBits == 12 ? "4k" : "2m", t->accesses, t->dtlbMisses,
+           t->walks, t->walkRefs, t->pwcHits);
+}
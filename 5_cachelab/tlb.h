@@ -0,0 +1,34 @@
+/**
+ * tlb.h - A two-level TLB and page walker, built from cachemodel caches
+ */
+
+#ifndef TLB_H
+#define TLB_H
+
+#include "cachemodel.h"
+
+// result of one translation
+#define TLB_HIT 0   // in the first level DTLB
+#define TLB_STLB 1  // missed the DTLB, hit the second level STLB
+#define TLB_WALK 2  // missed both: the page tables were walked
+
+#define MAX_WALK 4  // page table levels, x86-64 4-level paging
+
+typedef struct {
+    int pageBits;     // 12 for 4 KB pages, 21 for 2 MB pages
+    int walkLevels;   // page table levels a full walk reads
+    int hasStlb;
+    int walkCaches;   // walk loads go through the data caches
+    Cache dtlb, stlb;
+    Cache pwc;        // page walk cache of upper-level entries
+    int dtlbSets, dtlbWays, stlbSets, stlbWays, pwcEntries;
+    unsigned long accesses, dtlbMisses, walks, walkRefs, pwcHits;
+} Tlb;
+
+int tlbInit(Tlb* t, char* spec);
+void tlbFree(Tlb* t);
+int tlbAccess(Tlb* t, unsigned long address, unsigned long* refs,
+              int* nRefs);
+void printTlb(const Tlb* t);
+
+#endif /* TLB_H */
@@ -0,0 +1,80 @@
+/**
+ * traceconv.c - Convert memory traces between lackey text and the packed
+ * binary format that csim also reads (see tracefile.c)
+ *
+ * Usage: ./traceconv [-hdt] <in> <out>
+ */
+
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "tracefile.h"
+
+void printUsage() {
+    printf(
+        "Usage: ./traceconv [-hdt] <in> <out>\n"
+        "Options:\n"
+        "  -h         Print this help message.\n"
+        "  -d         Delta-encode addresses (smaller binary traces).\n"
+        "  -t         Write lackey text instead of binary.\n\n"
+        "Examples:\n"
+        "  linux>  ./traceconv -d traces/trans.trace trans.bin\n"
+        "  linux>  ./traceconv -t trans.bin trans.txt\n");
+}
+
+int main(int argc, char* argv[]) {
+    int opt, flags = 0, text = 0, rc;
+    unsigned long lastAddress = 0, records = 0;
+    TraceFile in;
+    TraceRecord rec;
+    FILE* out;
+
+    while ((opt = getopt(argc, argv, "hdt")) != -1) {
+        switch (opt) {
+            case 'd':
+                flags |= TRACE_DELTA;
+                break;
+            case 't':
+                text = 1;
+                break;
+            default:
+                printUsage();
+                exit(opt == 'h' ? 0 : -1);
+        }
+    }
+    if (optind != argc - 2) {
+        printUsage();
+        exit(-1);
+    }
+
+    if (openTrace(&in, argv[optind]) < 0) {
+        exit(-1);
+    }
+    if ((out = fopen(argv[optind + 1], "w")) == NULL) {
+        perror(argv[optind + 1]);
+        exit(-1);
+    }
+    if (!text && writeTraceHeader(out, flags) < 0) {
+        perror(argv[optind + 1]);
+        exit(-1);
+    }
+
+    // copy the records across, in lackey's layout when writing text
+    while ((rc = nextRecord(&in, &rec)) > 0) {
+        if (text) {
+            fprintf(out, "%s%c %lx,%u\n", rec.op == 'I' ? "" : " ", rec.op,
+                    rec.address, rec.size);
+        } else if (writeRecord(out, flags, &lastAddress, &rec) < 0) {
+            fprintf(stderr, "record %lu: cannot encode %c %lx,%u\n",
+                    records + 1, rec.op, rec.address, rec.size);
+            exit(-1);
+        }
+        records++;
+    }
+    closeTrace(&in);
+    if (fclose(out) != 0 || rc < 0) {
+        exit(-1);
+    }
+    printf("%lu records\n", records);
+    return 0;
+}
@@ -0,0 +1,404 @@
+/**
+ * tracefile.c - Reading and writing memory traces for the cache tools
+ *
+ * Traces are mapped into memory whole and parsed in place with a small
+ * hand-written scanner, rather than with one fscanf() per field. Standard
+ * input is read through a fixed buffer instead: the parser only ever
+ * sees whole lines (or whole binary records), and when they run out the
+ * unread tail moves to the front and the buffer is topped up, so a trace
+ * of any length is read in constant memory.
+ *
+ * Binary traces start with a 16-byte header (TRACE_MAGIC, a flags byte,
+ * zero padding). Each record is one byte holding the op in bits 0-1
+ * (I, L, S, M) and size - 1 in bits 2-7, followed by the address: eight
+ * little-endian bytes, or with TRACE_DELTA the difference from the
+ * previous record's address, zigzag-encoded as a base-128 varint, which
+ * is one to three bytes for most references.
+ */
+
+#define _DEFAULT_SOURCE
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "tracefile.h"
+
+static const char opChars[] = "ILSM";
+
+#define MAX_RECORD_LEN 11  // longest binary record: op byte, 10-byte varint
+
+/**
+ * Move the unread bytes of a streamed trace to the front of its buffer,
+ * read more input after them and find where the last complete record
+ * in the buffer ends
+ * @return 0, or -1 on a read error
+ */
+static int refill(TraceFile* tf) {
+    size_t kept = tf->limit - tf->pos;
+    char* limit;
+    ssize_t n;
+
+    memmove(tf->data, tf->pos, kept);
+    tf->pos = tf->data;
+    limit = tf->data + kept;
+    while (!tf->eof && limit < tf->data + tf->length) {
+        if ((n = read(tf->fd, limit, tf->data + tf->length - limit)) < 0) {
+            perror("trace");
+            return -1;
+        }
+        tf->eof = n == 0;
+        limit += n;
+    }
+    tf->limit = limit;
+
+    if (tf->eof) {
+        tf->end = limit;
+    } else if (tf->binary) {
+        tf->end = limit - MAX_RECORD_LEN + 1;
+    } else {
+        // up to the last newline, unless one line fills the buffer
+        const char* end = limit;
+        while (end > tf->data && end[-1] != '\n') {
+            end--;
+        }
+        tf->end = end > tf->data ? end : limit;
+    }
+    return 0;
+}
+
+/**
+ * Map a trace file, or start streaming standard input for "-", and
+ * detect its format
+ * @return 0 on success, -1 (with a message printed) on failure
+ */
+int openTrace(TraceFile* tf, const char* path) {
+    struct stat st;
+
+    memset(tf, 0, sizeof(*tf));
+    if (!strcmp(path, "-")) {
+        tf->fd = STDIN_FILENO;
+        tf->stream = 1;
+        tf->length = TRACE_STREAM_BUF;
+        if ((tf->data = malloc(tf->length)) == NULL) {
+            return -1;
+        }
+        tf->pos = tf->limit = tf->data;
+        if (refill(tf) < 0) {
+            return -1;
+        }
+        if (tf->limit - tf->data >= TRACE_HEADER_LEN &&
+            !memcmp(tf->data, TRACE_MAGIC, TRACE_MAGIC_LEN)) {
+            tf->binary =
+                TRACE_BINARY | (unsigned char)tf->data[TRACE_MAGIC_LEN];
+            tf->pos += TRACE_HEADER_LEN;
+            tf->end = tf->eof ? tf->limit : tf->limit - MAX_RECORD_LEN + 1;
+        }
+        tf->line = 1;
+        return 0;
+    }
+    if ((tf->fd = open(path, O_RDONLY)) < 0 || fstat(tf->fd, &st) < 0) {
+        perror(path);
+        return -1;
+    }
+    tf->length = st.st_size;
+    if (tf->length > 0) {
+        tf->data = mmap(NULL, tf->length, PROT_READ, MAP_PRIVATE, tf->fd, 0);
+        if (tf->data == MAP_FAILED) {
+            perror(path);
+            close(tf->fd);
+            return -1;
+        }
+        madvise(tf->data, tf->length, MADV_SEQUENTIAL);
+    }
+    tf->end = tf->limit = tf->data + tf->length;
+    if (tf->length >= TRACE_HEADER_LEN &&
+        !memcmp(tf->data, TRACE_MAGIC, TRACE_MAGIC_LEN)) {
+        tf->binary = TRACE_BINARY | (unsigned char)tf->data[TRACE_MAGIC_LEN];
+    }
+    rewindTrace(tf);
+    return 0;
+}
+
+/**
+ * Go back to the first record, to read the trace again (not possible
+ * when streaming)
+ */
+void rewindTrace(TraceFile* tf) {
+    tf->pos = tf->data + (tf->binary ? TRACE_HEADER_LEN : 0);
+    tf->lastAddress = 0;
+    tf->line = 1;
+}
+
+/**
+ * Parse a hexadecimal number
+ * @param p start of the digits, advanced past them
+ * @return the number; *p is unchanged if there are no digits
+ */
+static unsigned long parseHex(const char** p, const char* end) {
+    unsigned long value = 0;
+    unsigned int digit;
+    const char* q;
+
+    for (q = *p; q < end; q++) {
+        if (*q >= '0' && *q <= '9') {
+            digit = *q - '0';
+        } else if ((*q | 0x20) >= 'a' && (*q | 0x20) <= 'f') {
+            digit = (*q | 0x20) - 'a' + 10;
+        } else {
+            break;
+        }
+        value = value << 4 | digit;
+    }
+    *p = q;
+    return value;
+}
+
+/**
+ * Record the bounds declared by a "marker <start> <end>" line
+ */
+static void parseMarkers(TraceFile* tf, const char* p, const char* end) {
+    const char* q;
+
+    p += strlen("marker ");
+    tf->markerStart = parseHex(&p, end);
+    for (q = p; p < end && *p == ' '; p++) {
+    }
+    if (p == q) {
+        return;
+    }
+    q = p;
+    tf->markerEnd = parseHex(&p, end);
+    tf->markers = p > q;
+}
+
+/**
+ * Parse the next lackey text record. Lines that do not start with an
+ * op letter (valgrind's own "==pid==" messages) are skipped.
+ */
+static int nextTextRecord(TraceFile* tf, TraceRecord* rec) {
+    const char* p = tf->pos;
+    const char* end = tf->end;
+    unsigned long address;
+    unsigned int size;
+
+    while (p < end) {
+        while (p < end && *p == ' ') {
+            p++;
+        }
+        if (p + 1 < end && *p && strchr(opChars, *p) && p[1] == ' ') {
+            break;
+        }
+        if (end - p > 7 && !memcmp(p, "marker ", 7)) {
+            parseMarkers(tf, p, end);
+        }
+        // not a record: skip the rest of the line
+        while (p < end && *p++ != '\n') {
+        }
+        tf->line++;
+    }
+    if (p >= end) {
+        tf->pos = p;
+        return 0;
+    }
+
+    rec->op = *p;
+    for (p += 2; p < end && *p == ' '; p++) {
+    }
+    // hexadecimal address
+    const char* start = p;
+    address = parseHex(&p, end);
+    if (p == start) {
+        p = end;  // no digits
+    }
+    // ",size"
+    if (p >= end || *p++ != ',' || p >= end || *p < '0' || *p > '9') {
+        fprintf(stderr, "trace line %lu: malformed record\n", tf->line);
+        return -1;
+    }
+    for (size = 0; p < end && *p >= '0' && *p <= '9'; p++) {
+        size = size * 10 + (*p - '0');
+    }
+    while (p < end && *p++ != '\n') {
+    }
+    tf->line++;
+    tf->pos = p;
+    rec->address = address;
+    rec->size = size;
+    return 1;
+}
+
+/**
+ * Decode the next binary record
+ */
+static int nextBinaryRecord(TraceFile* tf, TraceRecord* rec) {
+    const unsigned char* p = (const unsigned char*)tf->pos;
+    const unsigned char* end = (const unsigned char*)tf->limit;
+    unsigned long value = 0;
+    int shift;
+
+    // a record must start before tf->end, but may run on to tf->limit
+    if (p >= (const unsigned char*)tf->end) {
+        return 0;
+    }
+    rec->op = opChars[*p & 3];
+    rec->size = (*p >> 2) + 1;
+    p++;
+    if (tf->binary & TRACE_DELTA) {
+        for (shift = 0; p < end && shift < 64; shift += 7) {
+            value |= (unsigned long)(*p & 0x7f) << shift;
+            if (!(*p++ & 0x80)) {
+                break;
+            }
+        }
+        if (shift >= 64 || (p[-1] & 0x80)) {
+            fprintf(stderr, "trace: truncated record\n");
+            return -1;
+        }
+        // undo zigzag: 0, 1, 2, 3 -> 0, -1, 1, -2
+        tf->lastAddress += (value >> 1) ^ -(value & 1);
+    } else {
+        if (end - p < 8) {
+            fprintf(stderr, "trace: truncated record\n");
+            return -1;
+        }
+        for (shift = 0; shift < 64; shift += 8) {
+            value |= (unsigned long)*p++ << shift;
+        }
+        tf->lastAddress = value;
+    }
+    rec->address = tf->lastAddress;
+    tf->pos = (const char*)p;
+    return 1;
+}
+
+/**
+ * Read the next record of either format
+ * @return 1 for a record, 0 at the end of the trace, -1 on a bad record
+ */
+int nextRecord(TraceFile* tf, TraceRecord* rec) {
+    int rc;
+
+    while (1) {
+        if (tf->binary) {
+            rc = nextBinaryRecord(tf, rec);
+        } else {
+            rc = nextTextRecord(tf, rec);
+        }
+        // out of buffered records: read on
+        if (rc != 0 || !tf->stream || tf->eof) {
+            return rc;
+        }
+        if (refill(tf) < 0) {
+            return -1;
+        }
+    }
+}
+
+/**
+ * Unmap and close a trace
+ */
+void closeTrace(TraceFile* tf) {
+    if (tf->stream) {
+        free(tf->data);
+    } else if (tf->data != NULL) {
+        munmap(tf->data, tf->length);
+    }
+    if (tf->fd >= 0 && !tf->stream) {
+        close(tf->fd);
+    }
+    tf->data = NULL;
+    tf->fd = -1;
+}
+
+/**
+ * Read the data addresses of a whole trace into an array, in the order
+ * csim accesses them: instruction fetches are skipped and a modify is
+ * a load and a store of the same address
+ * @param addresses set to a malloc'd array
+ * @param n set to its length
+ * @return 0, or -1 (with a message) on failure
+ */
+int loadTraceAddresses(const char* path, unsigned long** addresses,
+                       size_t* n) {
+    TraceFile tf;
+    TraceRecord rec;
+    size_t cap = 1 << 16, used = 0;
+    unsigned long* a;
+    int rc;
+
+    if (openTrace(&tf, path) < 0) {
+        return -1;
+    }
+    if ((a = malloc(cap * sizeof(unsigned long))) == NULL) {
+        closeTrace(&tf);
+        return -1;
+    }
+    while ((rc = nextRecord(&tf, &rec)) > 0) {
+        for (int k = rec.op == 'M' ? 2 : rec.op != 'I'; k > 0; k--) {
+            if (used == cap) {
+                unsigned long* grown =
+                    realloc(a, 2 * cap * sizeof(unsigned long));
+                if (grown == NULL) {
+                    rc = -1;
+                    break;
+                }
+                a = grown;
+                cap *= 2;
+            }
+            a[used++] = rec.address;
+        }
+    }
+    closeTrace(&tf);
+    if (rc < 0) {
+        fprintf(stderr, "%s: cannot load trace\n", path);
+        free(a);
+        return -1;
+    }
+    *addresses = a;
+    *n = used;
+    return 0;
+}
+
+/**
+ * Write the header of a binary trace
+ */
+int writeTraceHeader(FILE* fp, int flags) {
+    char header[TRACE_HEADER_LEN] = TRACE_MAGIC;
+
+    header[TRACE_MAGIC_LEN] = flags;
+    return fwrite(header, TRACE_HEADER_LEN, 1, fp) == 1 ? 0 : -1;
+}
+
+/**
+ * Append one record to a binary trace
+ * @param lastAddress previous address written, updated (for TRACE_DELTA)
+ */
+int writeRecord(FILE* fp, int flags, unsigned long* lastAddress,
+                const TraceRecord* rec) {
+    unsigned char buf[1 + 10];
+    unsigned long value;
+    long delta;
+    int n = 0;
+
+    if (rec->size < 1 || rec->size > 64 || !rec->op ||
+        !strchr(opChars, rec->op)) {
+        return -1;
+    }
+    buf[n++] = (strchr(opChars, rec->op) - opChars) | (rec->size - 1) << 2;
+    if (flags & TRACE_DELTA) {
+        delta = (long)(rec->address - *lastAddress);
+        value = ((unsigned long)delta << 1) ^ (unsigned long)(delta >> 63);
+        do {
+            buf[n++] = (value & 0x7f) | (value > 0x7f ? 0x80 : 0);
+            value >>= 7;
+        } while (value);
+    } else {
+        for (value = rec->address; n < 9; value >>= 8) {
+            buf[n++] = value & 0xff;
+        }
+    }
+    *lastAddress = rec->address;
+    return fwrite(buf, n, 1, fp) == 1 ? 0 : -1;
+}
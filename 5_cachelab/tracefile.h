@@ -0,0 +1,62 @@
+/**
+ * tracefile.h - Reading and writing memory traces for the cache tools
+ *
+ * A trace is either valgrind lackey text (" L 7ff0005b8,8" per line) or
+ * the packed binary format written by traceconv. Both are read through
+ * the same TraceFile, which detects the format from the file's header.
+ * The path "-" streams the trace from standard input.
+ *
+ * A text line "marker <start> <end>" (hex addresses, as tracegen prints
+ * it) is not a record; it declares the accesses that bound the region
+ * of interest, which the reader keeps in TraceFile.markerStart/End.
+ */
+
+#ifndef TRACEFILE_H
+#define TRACEFILE_H
+
+#include <stdio.h>
+
+// binary trace header: magic, then a flags byte
+#define TRACE_MAGIC "CSIMTRC"
+#define TRACE_MAGIC_LEN 8
+#define TRACE_HEADER_LEN 16
+#define TRACE_DELTA 0x1     // addresses are zigzag varint deltas
+#define TRACE_BINARY 0x100  // set in TraceFile.binary for binary traces
+#define TRACE_STREAM_BUF (1 << 20)  // bytes buffered when streaming
+
+// one trace record
+typedef struct {
+    char op;               // 'I', 'L', 'S' or 'M'
+    unsigned int size;     // bytes accessed, 1..64
+    unsigned long address; // data (or instruction) address
+} TraceRecord;
+
+// an open trace being read
+typedef struct {
+    int fd;
+    char* data;                // whole file mapped read-only, or a buffer
+    size_t length;             // of the mapping or buffer
+    const char* pos;           // next unread byte
+    const char* end;           // end of the records that can be parsed
+    int binary;                // 0 for text, else TRACE_BINARY | flags
+    unsigned long lastAddress; // previous address, for deltas
+    unsigned long line;        // text line number, for error messages
+    int stream;                // reading standard input through data
+    const char* limit;         // end of the mapped or buffered bytes
+    int eof;                   // streaming: no more input
+    int markers;               // a marker line has been read
+    unsigned long markerStart, markerEnd;
+} TraceFile;
+
+int openTrace(TraceFile* tf, const char* path);
+int nextRecord(TraceFile* tf, TraceRecord* rec);
+void rewindTrace(TraceFile* tf);
+void closeTrace(TraceFile* tf);
+int loadTraceAddresses(const char* path, unsigned long** addresses,
+                       size_t* n);
+
+int writeTraceHeader(FILE* fp, int flags);
+int writeRecord(FILE* fp, int flags, unsigned long* lastAddress,
+                const TraceRecord* rec);
+
+#endif /* TRACEFILE_H */
@@ -29,18 +29,40 @@ extern void __roi_end();
 
 static int A[256][256];
 static int B[256][256];
+static int C[256][256];
 static int M;
 static int N;
 
 
-int validate(int fn,int M, int N, int A[N][M], int B[M][N]) {
-    int C[M][N];
-    memset(C,0,sizeof(C));
-    correctTrans(M,N,A,C);
+/* Where function fn leaves A^T: B, or A's memory if it is in-place */
+void* output(int fn) {
+    return func_list[fn].inplace ? (void*)A : (void*)B;
+}
+
+/* Set C to the transpose of A, in function fn's elements; 0 if they do
+   not fit in A */
+int expect(int fn) {
+    int size = func_list[fn].elem_size;
+    if ((size_t)M*N*size > sizeof(A)) {
+        fprintf(stderr,"Skipping function %d: %d x %d elements of %d bytes do not fit\n",fn,M,N,size);
+        return 0;
+    }
+    correctTransElems(M,N,size,A,C);
+    return 1;
+}
+
+/* Compare function fn's result B with C, the transpose of A beforehand */
+int validate(int fn,int M, int N, const char* C, const char* B) {
+    int size = func_list[fn].elem_size;
     for(int i=0;i<M;i++) {
         for(int j=0;j<N;j++) {
-            if(B[i][j]!=C[i][j]) {
-                printf("Validation failed on function %d! Expected %d but got %d at B[%d][%d]\n",fn,C[i][j],B[i][j],i,j);
+            const int* c = (const int*)(C + ((size_t)i*N+j)*size);
+            const int* b = (const int*)(B + ((size_t)i*N+j)*size);
+            if(memcmp(b,c,size)) {
+                if(size==sizeof(int))
+                    printf("Validation failed on function %d! Expected %d but got %d at B[%d][%d]\n",fn,*c,*b,i,j);
+                else
+                    printf("Validation failed on function %d! Wrong %d-byte element at B[%d][%d]\n",fn,size,i,j);
                 return 0;
             }
         }
@@ -76,23 +98,28 @@ int entry(int argc, char* argv[]){
     /*  Register transpose functions */
     registerFunctions();
 
-    /* Fill A with data */
+    /* Fill A with data, all of it for functions with wider elements */
+    randMatrix(256,256,A);
     initMatrix(M,N, A, B);
 
     if (-1==selectedFunc) {
         /* Invoke registered transpose functions */
         for (i=0; i < func_counter; i++) {
+            if (!expect(i))
+                continue;
             __roi_begin();
-            (*func_list[i].func_ptr)(M, N, A, B);
+            (*func_list[i].func_ptr)(M, N, A, output(i));
             __roi_end();
-            if (!validate(i,M,N,A,B))
+            if (!validate(i,M,N,(char*)C,output(i)))
                 return i+1;
         }
     } else {
+        if (!expect(selectedFunc))
+            return 0;
         __roi_begin();
-        (*func_list[selectedFunc].func_ptr)(M, N, A, B);
+        (*func_list[selectedFunc].func_ptr)(M, N, A, output(selectedFunc));
         __roi_end();
-        if (!validate(selectedFunc,M,N,A,B))
+        if (!validate(selectedFunc,M,N,(char*)C,output(selectedFunc)))
             return selectedFunc+1;
 
     }
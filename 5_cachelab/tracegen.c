@@ -5,6 +5,9 @@
  * The beginning and end of each registered transpose function's trace
  * is indicated by reading from "marker" addresses. These two marker
  * addresses are recorded in file for later use.
+ *
+ * With -k, the kernels registered by kernels.c are traced instead, on
+ * A, B and a third N x N matrix C.
  */
 
 #include <stdlib.h>
@@ -19,26 +22,51 @@
 extern trans_func_t func_list[MAX_TRANS_FUNCS];
 extern int func_counter; 
 
-/* External function from trans.c */
+/* External functions from trans.c and kernels.c */
 extern void registerFunctions();
+extern void registerKernels();
 
 /* Markers used to bound trace regions of interest */
 volatile char MARKER_START, MARKER_END;
 
 static int A[256][256];
 static int B[256][256];
+static int C[256][256];
+static int K[256][256];  /* the third operand of kernels */
+static int EA[256][256], EB[256][256], EK[256][256];
 static int M;
 static int N;
 
 
-int validate(int fn,int M, int N, int A[N][M], int B[M][N]) {
-    int C[M][N];
-    memset(C,0,sizeof(C));
-    correctTrans(M,N,A,C);
+/* Where function fn leaves A^T: B, or A's memory if it is in-place */
+void* output(int fn) {
+    return func_list[fn].inplace ? (void*)A : (void*)B;
+}
+
+/* Set C to the transpose of A, in function fn's elements; 0 if they do
+   not fit in A */
+int expect(int fn) {
+    int size = func_list[fn].elem_size;
+    if ((size_t)M*N*size > sizeof(A)) {
+        fprintf(stderr,"Skipping function %d: %d x %d elements of %d bytes do not fit\n",fn,M,N,size);
+        return 0;
+    }
+    correctTransElems(M,N,size,A,C);
+    return 1;
+}
+
+/* Compare function fn's result B with C, the transpose of A beforehand */
+int validate(int fn,int M, int N, const char* C, const char* B) {
+    int size = func_list[fn].elem_size;
     for(int i=0;i<M;i++) {
         for(int j=0;j<N;j++) {
-            if(B[i][j]!=C[i][j]) {
-                printf("Validation failed on function %d! Expected %d but got %d at B[%d][%d]\n",fn,C[i][j],B[i][j],i,j);
+            const int* c = (const int*)(C + ((size_t)i*N+j)*size);
+            const int* b = (const int*)(B + ((size_t)i*N+j)*size);
+            if(memcmp(b,c,size)) {
+                if(size==sizeof(int))
+                    printf("Validation failed on function %d! Expected %d but got %d at B[%d][%d]\n",fn,*c,*b,i,j);
+                else
+                    printf("Validation failed on function %d! Wrong %d-byte element at B[%d][%d]\n",fn,size,i,j);
                 return 0;
             }
         }
@@ -46,12 +74,34 @@ int validate(int fn,int M, int N, int A[N][M], int B[M][N]) {
     return 1;
 }
 
+/* Run function fn between the markers; 0 if its result is wrong */
+int run(int fn) {
+    if (func_list[fn].kernel_ptr) {
+        expectKernel(fn,M,N,(int*)A,(int*)B,(int*)K,(int*)EA,(int*)EB,(int*)EK);
+        MARKER_START = 33;
+        (*func_list[fn].kernel_ptr)(M, N, A, B, K);
+        MARKER_END = 34;
+        if (!sameKernel(M,N,(int*)A,(int*)B,(int*)K,(int*)EA,(int*)EB,(int*)EK)) {
+            printf("Validation failed on kernel %d!\n",fn);
+            return 0;
+        }
+        return 1;
+    }
+    if (!expect(fn))
+        return 1;
+    MARKER_START = 33;
+    (*func_list[fn].func_ptr)(M, N, A, output(fn));
+    MARKER_END = 34;
+    return validate(fn,M,N,(char*)C,output(fn));
+}
+
 int main(int argc, char* argv[]){
     int i;
 
     char c;
     int selectedFunc=-1;
-    while( (c=getopt(argc,argv,"M:N:F:")) != -1){
+    int kernels=0;
+    while( (c=getopt(argc,argv,"M:N:F:k")) != -1){
         switch(c){
         case 'M':
             M = atoi(optarg);
@@ -62,6 +112,9 @@ int main(int argc, char* argv[]){
         case 'F':
             selectedFunc = atoi(optarg);
             break;
+        case 'k':
+            kernels = 1;
+            break;
         case '?':
         default:
             printf("./tracegen failed to parse its options.\n");
@@ -70,11 +123,18 @@ int main(int argc, char* argv[]){
     }
   
 
-    /*  Register transpose functions */
-    registerFunctions();
+    /*  Register transpose functions, or the other kernels */
+    if (kernels)
+        registerKernels();
+    else
+        registerFunctions();
 
-    /* Fill A with data */
-    initMatrix(M,N, A, B); 
+    /* Fill A with data, all of it for functions with wider elements */
+    randMatrix(256,256,A);
+    if (kernels)
+        initKernel(M,N, A, B, K);
+    else
+        initMatrix(M,N, A, B); 
 
     /* Record marker addresses */
     FILE* marker_fp = fopen(".marker","w");
@@ -84,20 +144,34 @@ int main(int argc, char* argv[]){
             (unsigned long long int) &MARKER_END );
     fclose(marker_fp);
 
+    /* Also announce them in the trace itself, for csim -m trace */
+    printf("marker %llx %llx\n",
+           (unsigned long long int) &MARKER_START,
+           (unsigned long long int) &MARKER_END);
+    fflush(stdout);
+
+    /* Record where the matrices live, for csim -a */
+    FILE* regions_fp = fopen(".regions","w");
+    assert(regions_fp);
+    fprintf(regions_fp, "A %llx %llx\nB %llx %llx\n",
+            (unsigned long long int) A,
+            (unsigned long long int) A + sizeof(int) * M * N,
+            (unsigned long long int) B,
+            (unsigned long long int) B + sizeof(int) * M * N);
+    if (kernels)
+        fprintf(regions_fp, "C %llx %llx\n",
+                (unsigned long long int) K,
+                (unsigned long long int) K + sizeof(int) * N * N);
+    fclose(regions_fp);
+
     if (-1==selectedFunc) {
         /* Invoke registered transpose functions */
         for (i=0; i < func_counter; i++) {
-            MARKER_START = 33;
-            (*func_list[i].func_ptr)(M, N, A, B);
-            MARKER_END = 34;
-            if (!validate(i,M,N,A,B))
+            if (!run(i))
                 return i+1;
         }
     } else {
-        MARKER_START = 33;
-        (*func_list[selectedFunc].func_ptr)(M, N, A, B);
-        MARKER_END = 34;
-        if (!validate(selectedFunc,M,N,A,B))
+        if (!run(selectedFunc))
             return selectedFunc+1;
 
     }
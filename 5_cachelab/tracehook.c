@@ -0,0 +1,91 @@
+/**
+ * tracehook.c - In-process memory tracing of code compiled with
+ * -fsanitize=thread, into a cachemodel cache
+ *
+ * ThreadSanitizer's compiler pass puts a call to __tsan_readN or
+ * __tsan_writeN before every load and store that may touch shared
+ * memory, so locals kept on the stack are left out, much as lackey
+ * traces are filtered for test-trans. Linking these definitions instead
+ * of the ThreadSanitizer runtime turns the calls into a memory trace,
+ * simulated as it happens: nothing is written out or parsed, and the
+ * traced code runs at nearly native speed.
+ *
+ * Like a lackey record, each access is one cache access at its address,
+ * whatever its size. Accesses are simulated only between traceInto(sink)
+ * and traceInto(NULL).
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+#include "tracehook.h"
+
+static TraceSink* current = NULL;
+
+/**
+ * Send accesses to a sink from now on, or stop tracing if sink is NULL
+ */
+void traceInto(TraceSink* sink) {
+    current = sink;
+}
+
+/**
+ * Simulate one access, if tracing
+ */
+void traceAccess(const volatile void* address, int write) {
+    if (current == NULL) {
+        return;
+    }
+    switch (cacheAccess(current->cache, (uintptr_t)address, 0, NULL)) {
+        case CACHE_HIT:
+            current->hits++;
+            break;
+        case CACHE_MISS:
+            current->misses++;
+            break;
+        default:
+            current->misses++;
+            current->evictions++;
+            break;
+    }
+}
+
+// the hooks the instrumented code calls
+void __tsan_init(void) {}
+void __tsan_func_entry(void* pc) {}
+void __tsan_func_exit(void) {}
+
+#define TSAN_HOOKS(n)                               \
+    void __tsan_read##n(void* p) {                  \
+        traceAccess(p, 0);                          \
+    }                                               \
+    void __tsan_write##n(void* p) {                 \
+        traceAccess(p, 1);                          \
+    }                                               \
+    void __tsan_unaligned_read##n(void* p) {        \
+        traceAccess(p, 0);                          \
+    }                                               \
+    void __tsan_unaligned_write##n(void* p) {       \
+        traceAccess(p, 1);                          \
+    }
+
+TSAN_HOOKS(1)
+TSAN_HOOKS(2)
+TSAN_HOOKS(4)
+TSAN_HOOKS(8)
+TSAN_HOOKS(16)
+
+void __tsan_read_range(void* p, unsigned long size) {
+    traceAccess(p, 0);
+}
+
+void __tsan_write_range(void* p, unsigned long size) {
+    traceAccess(p, 1);
+}
+
+void __tsan_vptr_read(void** p) {
+    traceAccess(p, 0);
+}
+
+void __tsan_vptr_update(void** p, void* value) {
+    traceAccess(p, 1);
+}
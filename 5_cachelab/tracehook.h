@@ -0,0 +1,20 @@
+/**
+ * tracehook.h - In-process memory tracing of code compiled with
+ * -fsanitize=thread, into a cachemodel cache
+ */
+
+#ifndef TRACEHOOK_H
+#define TRACEHOOK_H
+
+#include "cachemodel.h"
+
+// where traced accesses go, and what they did
+typedef struct {
+    Cache* cache;
+    unsigned long hits, misses, evictions;
+} TraceSink;
+
+void traceInto(TraceSink* sink);
+void traceAccess(const volatile void* address, int write);
+
+#endif /* TRACEHOOK_H */
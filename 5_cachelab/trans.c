@@ -7,11 +7,19 @@
  * A transpose function is evaluated by counting the number of misses
  * on a 1KB direct mapped cache with a block size of 32 bytes.
  */
+#include <complex.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include "cachelab.h"
 #include "contracts.h"
 
 int is_transpose(int M, int N, int A[N][M], int B[M][N]);
+static int tuned_tile(int M, int N);
+
+/* A tile of rows x cols elements of A, packed into one int */
+#define TILE(rows, cols) ((rows) << 8 | (cols))
+#define TILE_ROWS(t) ((t) >> 8)
+#define TILE_COLS(t) ((t) & 0xff)
 
 /*
  * transpose_submit - This is the solution transpose function that you
@@ -26,7 +34,7 @@ void transpose_submit(int M, int N, int A[N][M], int B[M][N]) {
     REQUIRES(M > 0);
     REQUIRES(N > 0);
 
-    int i, j, k, a0, a1, a2, a3, a4, a5, a6, a7;
+    int i, j, k, l, a0, a1, a2, a3, a4, a5, a6, a7;
     // 32 * 32
     if (M == 32 && N == 32) {
         for (i = 0; i < N; i += 8) {
@@ -55,8 +63,7 @@ void transpose_submit(int M, int N, int A[N][M], int B[M][N]) {
     }
 
     // 64 * 64
-
-    if (M == 64 && N == 64) {
+    else if (M == 64 && N == 64) {
         for (i = 0; i < N; i += 8) {
             for (j = 0; j < M; j += 8) {
                 /*
@@ -127,10 +134,10 @@ void transpose_submit(int M, int N, int A[N][M], int B[M][N]) {
     }
 
     // 60 * 68
-    if (M == 60 && N == 68) {
-        for (int i = 0; i < N; i += 20) {
-            for (int j = 0; j < M; j += 4) {
-                for (int k = i; k < (i + 20) && (k < N); k++) {
+    else if (M == 60 && N == 68) {
+        for (i = 0; i < N; i += 20) {
+            for (j = 0; j < M; j += 4) {
+                for (k = i; k < (i + 20) && (k < N); k++) {
                     // just divide the matrix into 4 * 4
                     a0 = A[k][j];
                     a1 = A[k][j + 1];
@@ -145,6 +152,22 @@ void transpose_submit(int M, int N, int A[N][M], int B[M][N]) {
         }
     }
 
+    // any other shape: blocked, in tiles of a0 rows by a1 columns
+    // tuned on the simulator, inline to keep to 12 locals
+    else {
+        a0 = TILE_ROWS(tuned_tile(M, N));
+        a1 = TILE_COLS(tuned_tile(M, N));
+        for (i = 0; i < N; i += a0) {
+            for (j = 0; j < M; j += a1) {
+                for (k = i; k < i + a0 && k < N; k++) {
+                    for (l = j; l < j + a1 && l < M; l++) {
+                        B[l][k] = A[k][l];
+                    }
+                }
+            }
+        }
+    }
+
     ENSURES(is_transpose(M, N, A, B));
 }
 /*
@@ -173,6 +196,283 @@ void trans(int M, int N, int A[N][M], int B[M][N]) {
     ENSURES(is_transpose(M, N, A, B));
 }
 
+/*
+ * trans_tile - Transpose rows i0..i1-1 and columns j0..j1-1 of A. On the
+ *     diagonal, A[i][i] and B[i][i] map to the same set when A and B are
+ *     a multiple of the cache size apart, so B[i][i] is written after
+ *     the rest of the row instead of evicting the line of A in use.
+ */
+static void trans_tile(int M, int N, int A[N][M], int B[M][N],
+                       int i0, int i1, int j0, int j1)
+{
+    int i, j, d = 0, diag;
+
+    for (i = i0; i < i1; i++) {
+        diag = -1;
+        for (j = j0; j < j1; j++) {
+            if (i == j) {
+                d = A[i][j];
+                diag = i;
+            } else {
+                B[j][i] = A[i][j];
+            }
+        }
+        if (diag >= 0) {
+            B[diag][diag] = d;
+        }
+    }
+}
+
+/*
+ * trans_blocked - Transpose in tiles of rows x cols elements of A, the
+ *     last tiles of each row and column cut short
+ */
+static void trans_blocked(int M, int N, int A[N][M], int B[M][N],
+                          int rows, int cols)
+{
+    int i, j;
+
+    for (i = 0; i < N; i += rows) {
+        for (j = 0; j < M; j += cols) {
+            trans_tile(M, N, A, B, i, i + rows < N ? i + rows : N,
+                       j, j + cols < M ? j + cols : M);
+        }
+    }
+}
+
+/*
+ * tuned_tile - The tile trans_blocked uses for an M x N matrix. The
+ *     shapes below were tuned for the graded cache (s = 5, E = 1, b = 5)
+ *     by ./transtune; the if-chain reads no data, so looking up the tile
+ *     adds no misses. Other shapes get square tiles one line of ints
+ *     wide.
+ */
+static int tuned_tile(int M, int N)
+{
+    // ./transtune -s 5 -E 1 -b 5 64x64 60x68 61x67 128x128
+    if (M == 64 && N == 64) {
+        return TILE(8, 4);  // 1744 misses; 8x8 4632, recursive 4632
+    }
+    if (M == 60 && N == 68) {
+        return TILE(24, 4);  // 1583 misses; 8x8 1753, recursive 2075
+    }
+    if (M == 61 && N == 67) {
+        return TILE(14, 1);  // 1804 misses; 8x8 2109, recursive 2040
+    }
+    if (M == 128 && N == 128) {
+        return TILE(8, 2);  // 11072 misses; 8x8 18736, recursive 18736
+    }
+    return TILE(8, 8);
+}
+
+/*
+ * transpose_tuned - Blocked transpose for any shape, tiles from
+ *     tuned_tile
+ */
+char transpose_tuned_desc[] = "Blocked transpose, simulator-tuned tiles";
+void transpose_tuned(int M, int N, int A[N][M], int B[M][N])
+{
+    int tile = tuned_tile(M, N);
+
+    REQUIRES(M > 0);
+    REQUIRES(N > 0);
+
+    trans_blocked(M, N, A, B, TILE_ROWS(tile), TILE_COLS(tile));
+
+    ENSURES(is_transpose(M, N, A, B));
+}
+
+/* Sub-matrices at most this many elements a side are not split further */
+#define REC_BASE 8
+
+/*
+ * trans_rec - Transpose rows i0..i1-1 and columns j0..j1-1 of A by
+ *     halving the longer side until the piece is small
+ */
+static void trans_rec(int M, int N, int A[N][M], int B[M][N],
+                      int i0, int i1, int j0, int j1)
+{
+    int mid;
+
+    if (i1 - i0 <= REC_BASE && j1 - j0 <= REC_BASE) {
+        trans_tile(M, N, A, B, i0, i1, j0, j1);
+    } else if (i1 - i0 >= j1 - j0) {
+        mid = i0 + (i1 - i0) / 2;
+        trans_rec(M, N, A, B, i0, mid, j0, j1);
+        trans_rec(M, N, A, B, mid, i1, j0, j1);
+    } else {
+        mid = j0 + (j1 - j0) / 2;
+        trans_rec(M, N, A, B, i0, i1, j0, mid);
+        trans_rec(M, N, A, B, i0, i1, mid, j1);
+    }
+}
+
+/*
+ * transpose_recursive - Cache-oblivious transpose: the recursion reaches
+ *     pieces that fit whatever the cache, without knowing its size
+ */
+char transpose_recursive_desc[] = "Recursive cache-oblivious transpose";
+void transpose_recursive(int M, int N, int A[N][M], int B[M][N])
+{
+    REQUIRES(M > 0);
+    REQUIRES(N > 0);
+
+    trans_rec(M, N, A, B, 0, N, 0, M);
+
+    ENSURES(is_transpose(M, N, A, B));
+}
+
+/* Tiles of the square in-place transpose: one line of ints a side */
+#define SWAP_TILE 8
+
+/*
+ * swap_blocked - Transpose a square matrix in place, a pair of tiles at
+ *     a time: each tile above the diagonal is swapped with the transpose
+ *     of its mirror below it, and each tile on the diagonal with itself
+ */
+static void swap_blocked(int N, int A[N][N])
+{
+    int i, j, ii, jj, t;
+
+    for (ii = 0; ii < N; ii += SWAP_TILE) {
+        for (jj = ii; jj < N; jj += SWAP_TILE) {
+            for (i = ii; i < ii + SWAP_TILE && i < N; i++) {
+                for (j = ii == jj ? i + 1 : jj; j < jj + SWAP_TILE && j < N;
+                     j++) {
+                    t = A[i][j];
+                    A[i][j] = A[j][i];
+                    A[j][i] = t;
+                }
+            }
+        }
+    }
+}
+
+/*
+ * cycle_follow - Transpose N rows of M ints in place, as a permutation
+ *     of its elements: the one at k = i * M + j belongs at j * N + i,
+ *     which is k * N mod (M * N - 1) for all but the last. Each cycle of
+ *     the permutation is followed from its first element, carrying one
+ *     element along, and a bit per element marks those already moved so
+ *     that no cycle is followed twice. Returns -1 if the bits cannot be
+ *     allocated, else 0.
+ */
+static int cycle_follow(int M, int N, int *a)
+{
+    long last = (long)M * N - 1, start, k;
+    unsigned char *moved;
+    int carry, t;
+
+    moved = calloc(last / 8 + 1, 1);
+    if (moved == NULL) {
+        return -1;
+    }
+    for (start = 1; start < last; start++) {
+        if (moved[start >> 3] & 1 << (start & 7)) {
+            continue;
+        }
+        carry = a[start];
+        k = start;
+        do {
+            k = k * N % last;
+            t = a[k];
+            a[k] = carry;
+            carry = t;
+            moved[k >> 3] |= 1 << (k & 7);
+        } while (k != start);
+    }
+    free(moved);
+    return 0;
+}
+
+/*
+ * transpose_inplace - In-place transpose, for matrices too big to hold
+ *     twice: swap-blocked if square, else cycle-following. Registered
+ *     with registerInplaceFunction, so it is called with B = A and
+ *     leaves A^T, an M x N matrix, in A's memory.
+ */
+char transpose_inplace_desc[] = "In-place transpose, swap-blocked if square";
+void transpose_inplace(int M, int N, int A[N][M], int B[M][N])
+{
+    REQUIRES(M > 0);
+    REQUIRES(N > 0);
+    REQUIRES((void *)A == (void *)B);
+
+    if (M == N) {
+        swap_blocked(N, A);
+    } else if (cycle_follow(M, N, &A[0][0]) < 0) {
+        fprintf(stderr, "transpose_inplace: out of memory\n");
+        exit(1);
+    }
+}
+
+/*
+ * transpose_inplace_cycles - In-place transpose by cycle-following
+ *     alone, square or not, to compare with swap-blocking
+ */
+char transpose_inplace_cycles_desc[] = "In-place transpose, cycle-following";
+void transpose_inplace_cycles(int M, int N, int A[N][M], int B[M][N])
+{
+    REQUIRES(M > 0);
+    REQUIRES(N > 0);
+    REQUIRES((void *)A == (void *)B);
+
+    if (cycle_follow(M, N, &A[0][0]) < 0) {
+        fprintf(stderr, "transpose_inplace_cycles: out of memory\n");
+        exit(1);
+    }
+}
+
+/* Bytes in a line, and in all of the graded cache (s = 5, E = 1, b = 5) */
+#define LINE_BYTES 32
+#define CACHE_BYTES 1024
+#define CACHE_LINES (CACHE_BYTES / LINE_BYTES)
+
+/* Tile side for elements of type T: as many as fill a line, at least 1,
+   but no more than a quarter of the cache's lines */
+#define ELEM_TILE(T)                                                        \
+    (sizeof(T) >= LINE_BYTES ? 1 :                                          \
+     LINE_BYTES / sizeof(T) > CACHE_LINES / 4 ? CACHE_LINES / 4 :           \
+     (int)(LINE_BYTES / sizeof(T)))
+
+/*
+ * DEFINE_ELEM_TRANSPOSE - Define name, a blocked transpose of elements of
+ *     type T in square tiles of ELEM_TILE(T). A tile's row of A fills at
+ *     most one line, and its columns of B take a line per row of the
+ *     tile; for small elements a line-wide tile would have more rows
+ *     than the cache has lines to spare, so the side is capped and the
+ *     tile's lines of A and B stay cached together. A and B hold T
+ *     elements, cast to int matrices to match the function list;
+ *     register name with registerElemFunction.
+ */
+#define DEFINE_ELEM_TRANSPOSE(name, T)                                      \
+char name##_desc[] = "Blocked transpose of " #T " elements";               \
+void name(int M, int N, int A_[N][M], int B_[M][N])                         \
+{                                                                           \
+    T (*A)[M] = (T (*)[M])A_;                                               \
+    T (*B)[N] = (T (*)[N])B_;                                               \
+    int i, j, ii, jj, tile = ELEM_TILE(T);                                  \
+                                                                            \
+    REQUIRES(M > 0);                                                        \
+    REQUIRES(N > 0);                                                        \
+                                                                            \
+    for (ii = 0; ii < N; ii += tile) {                                      \
+        for (jj = 0; jj < M; jj += tile) {                                  \
+            for (i = ii; i < ii + tile && i < N; i++) {                     \
+                for (j = jj; j < jj + tile && j < M; j++) {                 \
+                    B[j][i] = A[i][j];                                      \
+                }                                                           \
+            }                                                               \
+        }                                                                   \
+    }                                                                       \
+}
+
+DEFINE_ELEM_TRANSPOSE(transpose_char, char)
+DEFINE_ELEM_TRANSPOSE(transpose_short, short)
+DEFINE_ELEM_TRANSPOSE(transpose_float, float)
+DEFINE_ELEM_TRANSPOSE(transpose_double, double)
+DEFINE_ELEM_TRANSPOSE(transpose_complex, double complex)
+
 /*
  * registerFunctions - This function registers your transpose
  *     functions with the driver.  At runtime, the driver will
@@ -186,6 +486,24 @@ void registerFunctions() {
 
     /* Register any additional transpose functions */
     registerTransFunction(trans, trans_desc);
+    registerTransFunction(transpose_tuned, transpose_tuned_desc);
+    registerTransFunction(transpose_recursive, transpose_recursive_desc);
+
+    /* And the in-place ones, which the drivers call with B = A */
+    registerInplaceFunction(transpose_inplace, transpose_inplace_desc);
+    registerInplaceFunction(transpose_inplace_cycles,
+                            transpose_inplace_cycles_desc);
+
+    /* And the ones for elements other than int */
+    registerElemFunction(transpose_char, transpose_char_desc, sizeof(char));
+    registerElemFunction(transpose_short, transpose_short_desc,
+                         sizeof(short));
+    registerElemFunction(transpose_float, transpose_float_desc,
+                         sizeof(float));
+    registerElemFunction(transpose_double, transpose_double_desc,
+                         sizeof(double));
+    registerElemFunction(transpose_complex, transpose_complex_desc,
+                         sizeof(double complex));
 }
 
 /*
@@ -0,0 +1,160 @@
+/**
+ * transbench.c - Time the native transposes in GB/s
+ *
+ * The transposes are registered with registerTransFunction, as trans.c
+ * registers its own: correctTrans, the blocked scalar transpose, each
+ * SIMD transpose the CPU supports and the multithreaded one. For each
+ * matrix shape, fills A, then runs every registered transpose, best of a
+ * few runs, checks every result and prints the time and the bandwidth:
+ * M x N ints read from A and written to B.
+ *
+ * Usage: ./transbench [-hf] [-r <runs>] [-t <threads>] [<M>x<N> | <N>]...
+ */
+
+#define _POSIX_C_SOURCE 200112L
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "cachelab.h"
+#include "transpar.h"
+#include "transsimd.h"
+
+extern trans_func_t func_list[MAX_TRANS_FUNCS];
+extern int func_counter;
+
+void printUsage() {
+    printf(
+        "Usage: ./transbench [-hf] [-r <runs>] [-t <threads>] "
+        "[<M>x<N> | <N>]...\n"
+        "Options:\n"
+        "  -h         Print this help message.\n"
+        "  -f         Let the parallel transpose's threads first touch A\n"
+        "             and B, to place their pages on the threads' nodes.\n"
+        "  -r <runs>  Runs per transpose; the fastest counts (default 3).\n"
+        "  -t <threads> Threads for the parallel transpose (default one\n"
+        "             per CPU).\n"
+        "Shapes are M columns by N rows of A, or N for N x N (default\n"
+        "1024 4096).\n\n"
+        "Examples:\n"
+        "  linux>  ./transbench -r 1 1000x3000 16384\n"
+        "  linux>  ./transbench -f -t 8 16384\n");
+}
+
+/**
+ * Seconds on a monotonic clock
+ */
+static double now() {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+/**
+ * Time one transpose and check its result
+ */
+static void bench(const char* name, TransposeFunc f, int M, int N, int* A,
+                  int* B, int runs) {
+    double best = 1e30, bytes = 2.0 * M * N * sizeof(int);
+
+    for (int r = 0; r < runs; r++) {
+        double start, elapsed;
+        memset(B, 0, (size_t)M * N * sizeof(int));
+        start = now();
+        f(M, N, (int(*)[M])A, (int(*)[N])B);
+        elapsed = now() - start;
+        if (elapsed < best) {
+            best = elapsed;
+        }
+    }
+    for (size_t j = 0; j < (size_t)M; j++) {
+        for (size_t i = 0; i < (size_t)N; i++) {
+            if (B[j * N + i] != A[i * M + j]) {
+                fprintf(stderr, "%s: wrong result at B[%zu][%zu]\n", name, j,
+                        i);
+                exit(-1);
+            }
+        }
+    }
+    printf("%-12s %6dx%-6d %10.3f ms %8.2f GB/s\n", name, M, N, best * 1e3,
+           bytes / best / 1e9);
+}
+
+int main(int argc, char* argv[]) {
+    static char* defaults[] = {"1024", "4096"};
+    char** shapes = defaults;
+    int nShapes = 2, runs = 3, firstTouch = 0, opt;
+
+    while ((opt = getopt(argc, argv, "hfr:t:")) != -1) {
+        switch (opt) {
+            case 'f':
+                firstTouch = 1;
+                break;
+            case 'r':
+                runs = atoi(optarg);
+                break;
+            case 't':
+                transposeSetThreads(atoi(optarg));
+                break;
+            default:
+                printUsage();
+                exit(opt == 'h' ? 0 : -1);
+        }
+    }
+    if (runs < 1) {
+        printUsage();
+        exit(-1);
+    }
+    if (optind < argc) {
+        shapes = argv + optind;
+        nShapes = argc - optind;
+    }
+
+    registerTransFunction(correctTrans, "correctTrans");
+    registerTransFunction(transposeScalar, "scalar");
+    if (cpuHasSse()) {
+        registerTransFunction(transposeSse, "sse2");
+    }
+    if (cpuHasAvx2()) {
+        registerTransFunction(transposeAvx2, "avx2");
+    }
+    registerTransFunction(transposeParallel, "parallel");
+
+    printf("transposeFast uses %s; parallel uses %d threads\n",
+           transposeFastName(), transposeThreads());
+    for (int k = 0; k < nShapes; k++) {
+        int M, N;
+        size_t size;
+        int *A, *B;
+
+        if (sscanf(shapes[k], "%dx%d", &M, &N) == 1) {
+            N = M;
+        }
+        if (M <= 0 || N <= 0) {
+            fprintf(stderr, "bad shape: %s\n", shapes[k]);
+            exit(-1);
+        }
+        size = (size_t)M * N * sizeof(int);
+        if (posix_memalign((void**)&A, 64, size) != 0 ||
+            posix_memalign((void**)&B, 64, size) != 0) {
+            fprintf(stderr, "out of memory for %s\n", shapes[k]);
+            exit(-1);
+        }
+        if (firstTouch) {
+            transposeFirstTouch(M, N, (int(*)[M])A, (int(*)[N])B);
+        }
+        for (size_t i = 0; i < (size_t)M * N; i++) {
+            A[i] = (int)i;
+        }
+
+        for (int f = 0; f < func_counter; f++) {
+            bench(func_list[f].description, func_list[f].func_ptr, M, N, A,
+                  B, runs);
+        }
+        free(A);
+        free(B);
+    }
+    return 0;
+}
@@ -0,0 +1,202 @@
+/**
+ * transpar.c - Multithreaded blocked transpose on a pool of threads
+ *
+ * A large transpose is bound by memory bandwidth, which one core cannot
+ * use up. The matrix is cut into square tiles, each transposed by the
+ * transsimd kernels, and the tiles are dealt out to a pool of threads
+ * that lives from the first call on; the calling thread takes a share
+ * too.
+ *
+ * Tile t covers tile row r = t mod R of A and tile column
+ * c = (t / R + r) mod C, a diagonal order. The tiles a round of threads
+ * works on at the same time are in different tile rows and columns, so
+ * they read A and write B at different offsets within their rows: with
+ * power-of-two rows, tiles of one column would all map to the same sets
+ * of a shared cache. Thread k always takes tiles k, k + n, k + 2n, ...,
+ * so transposeFirstTouch can zero the pages of A and B each thread will
+ * use from that thread, and the kernel places them on its NUMA node.
+ */
+
+#include <pthread.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include "transpar.h"
+#include "transsimd.h"
+
+#define SMALL (1L << 16)  // ints; smaller matrices take one thread
+
+#define JOB_TRANSPOSE 0
+#define JOB_TOUCH 1
+
+typedef struct {
+    int kind;  // JOB_*
+    int M, N;
+    int* A;
+    int* B;
+    int workers;  // threads sharing the job, the caller included
+} Job;
+
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t wake = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t finished = PTHREAD_COND_INITIALIZER;
+static pthread_t threads[MAX_THREADS];
+static int wanted = 0;              // threads to use, 0 for one per CPU
+static int started = 0;             // pool threads running
+static unsigned long generation = 0;  // jobs handed out so far
+static int busy = 0;                // pool threads still on the job
+static Job job;
+
+/**
+ * Use n threads from now on, or one per online CPU if n is 0
+ */
+void transposeSetThreads(int n) {
+    wanted = n < 0 ? 0 : n > MAX_THREADS ? MAX_THREADS : n;
+}
+
+/**
+ * The number of threads a transpose will use
+ */
+int transposeThreads(void) {
+    long n = wanted;
+
+    if (n == 0) {
+        n = sysconf(_SC_NPROCESSORS_ONLN);
+    }
+    return n < 1 ? 1 : n > MAX_THREADS ? MAX_THREADS : (int)n;
+}
+
+/**
+ * Tile side for a job: the largest that gives every thread four tiles.
+ * 1024 ints is a 4 KB page, so whole pages of each tile row are first
+ * touched by the thread that uses them.
+ */
+static int tileSide(const Job* j) {
+    int side = 1024;
+
+    while (side > 64 && (long)((j->M + side - 1) / side) *
+                                ((j->N + side - 1) / side) <
+                            4L * j->workers) {
+        side /= 2;
+    }
+    return side;
+}
+
+/**
+ * Do thread k's tiles of a job
+ */
+static void runShare(const Job* j, int k) {
+    int side = tileSide(j);
+    int R = (j->N + side - 1) / side;
+    int C = (j->M + side - 1) / side;
+
+    for (long t = k; t < (long)R * C; t += j->workers) {
+        int r = t % R, c = (t / R + r) % C;
+        int i0 = r * side, i1 = i0 + side < j->N ? i0 + side : j->N;
+        int j0 = c * side, j1 = j0 + side < j->M ? j0 + side : j->M;
+
+        if (j->kind == JOB_TRANSPOSE) {
+            transposeFastPiece(j->M, j->N, (int(*)[j->M])j->A,
+                               (int(*)[j->N])j->B, i0, i1, j0, j1);
+        } else {
+            for (int i = i0; i < i1; i++) {
+                memset(j->A + (size_t)i * j->M + j0, 0,
+                       (j1 - j0) * sizeof(int));
+            }
+            for (int jj = j0; jj < j1; jj++) {
+                memset(j->B + (size_t)jj * j->N + i0, 0,
+                       (i1 - i0) * sizeof(int));
+            }
+        }
+    }
+}
+
+/**
+ * Pool thread: wait for a job, do its share, repeat
+ */
+static void* worker(void* arg) {
+    int k = (int)(intptr_t)arg;
+    unsigned long seen = 0;  // created just before the job it is for
+
+    pthread_mutex_lock(&lock);
+    for (;;) {
+        while (generation == seen) {
+            pthread_cond_wait(&wake, &lock);
+        }
+        seen = generation;
+        Job j = job;
+        pthread_mutex_unlock(&lock);
+
+        if (k < j.workers) {
+            runShare(&j, k);
+        }
+
+        pthread_mutex_lock(&lock);
+        if (--busy == 0) {
+            pthread_cond_signal(&finished);
+        }
+    }
+    return NULL;
+}
+
+/**
+ * Run a job on the pool and the calling thread, growing the pool if
+ * needed, and wait for it to finish
+ */
+static void runJob(Job* j) {
+    int n = transposeThreads();
+
+    // pick the kernel now rather than in every thread at once
+    transposeFastPiece(j->M, j->N, (int(*)[j->M])j->A, (int(*)[j->N])j->B,
+                       0, 0, 0, 0);
+
+    pthread_mutex_lock(&lock);
+    while (started < n - 1) {
+        if (pthread_create(&threads[started], NULL, worker,
+                           (void*)(intptr_t)(started + 1)) != 0) {
+            n = started + 1;  // make do with the threads there are
+            break;
+        }
+        pthread_detach(threads[started]);
+        started++;
+    }
+    j->workers = n;
+    job = *j;
+    generation++;
+    busy = started;
+    pthread_cond_broadcast(&wake);
+    pthread_mutex_unlock(&lock);
+
+    runShare(j, 0);
+
+    pthread_mutex_lock(&lock);
+    while (busy > 0) {
+        pthread_cond_wait(&finished, &lock);
+    }
+    pthread_mutex_unlock(&lock);
+}
+
+/**
+ * Transpose on all the pool's threads
+ */
+void transposeParallel(int M, int N, int A[N][M], int B[M][N]) {
+    Job j = {JOB_TRANSPOSE, M, N, &A[0][0], &B[0][0], 0};
+
+    // waking the pool costs more than a small transpose
+    if ((long)M * N < SMALL) {
+        transposeFast(M, N, A, B);
+        return;
+    }
+    runJob(&j);
+}
+
+/**
+ * Zero A and B, each page from the thread that will transpose it, so
+ * that first-touch placement puts it on that thread's NUMA node. Call
+ * before filling A, with the thread count the transposes will use.
+ */
+void transposeFirstTouch(int M, int N, int A[N][M], int B[M][N]) {
+    Job j = {JOB_TOUCH, M, N, &A[0][0], &B[0][0], 0};
+
+    runJob(&j);
+}
@@ -0,0 +1,15 @@
+/**
+ * transpar.h - Multithreaded blocked transpose on a pool of threads
+ */
+
+#ifndef TRANSPAR_H
+#define TRANSPAR_H
+
+#define MAX_THREADS 64
+
+void transposeSetThreads(int n);
+int transposeThreads(void);
+void transposeParallel(int M, int N, int A[N][M], int B[M][N]);
+void transposeFirstTouch(int M, int N, int A[N][M], int B[M][N]);
+
+#endif /* TRANSPAR_H */
@@ -0,0 +1,286 @@
+/**
+ * transsimd.c - Fast native transposes: SSE2 and AVX2 micro-kernels in
+ * cache-sized tiles, picked at run time by what the CPU supports
+ *
+ * The trans.c functions are scalar and tuned for misses in the small
+ * simulated cache. These are for speed on the machine itself. A
+ * micro-kernel transposes a K x K block in registers: K rows of A are
+ * loaded, interleaved with unpack and permute instructions, and stored
+ * as K rows of B. Kernels are swept over TILE x TILE tiles, so that a
+ * tile's rows of A and of B stay in L1 while they are used, and down
+ * the rows of A within a tile, so that the lines of B one kernel fills
+ * in part are finished by the next. The edges of a tile that do not
+ * fill a whole kernel are done one element at a time.
+ *
+ * The SIMD code is compiled with per-function target attributes, so the
+ * file builds with the default flags and runs on any x86-64; other
+ * machines get the scalar version only.
+ */
+
+#include <stddef.h>
+#include "transsimd.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define HAVE_X86 1
+#endif
+
+#define TILE 32  // tile side in ints: 4 KB of A and 4 KB of B
+
+/**
+ * Transpose rows i0..i1-1 and columns j0..j1-1 of A one element at a time
+ */
+static void scalarPiece(int M, int N, int A[N][M], int B[M][N], int i0,
+                        int i1, int j0, int j1) {
+    for (int i = i0; i < i1; i++) {
+        for (int j = j0; j < j1; j++) {
+            B[j][i] = A[i][j];
+        }
+    }
+}
+
+/**
+ * Sweep a K x K kernel over each TILE x TILE tile of rows r0..r1-1 and
+ * columns c0..c1-1 of A. KERNEL(a, lda, b, ldb) transposes the block at
+ * a, rows lda ints apart, to b, rows ldb apart.
+ */
+#define TRANSPOSE_TILED(K, KERNEL)                                          \
+    for (int ii = r0; ii < r1; ii += TILE) {                                \
+        for (int jj = c0; jj < c1; jj += TILE) {                            \
+            int i1 = ii + TILE < r1 ? ii + TILE : r1;                       \
+            int j1 = jj + TILE < c1 ? jj + TILE : c1;                       \
+            int iEnd = ii + (i1 - ii) / (K) * (K);                          \
+            int jEnd = jj + (j1 - jj) / (K) * (K);                          \
+            for (int j = jj; j < jEnd; j += (K)) {                          \
+                for (int i = ii; i < iEnd; i += (K)) {                      \
+                    KERNEL(&A[i][j], M, &B[j][i], N);                       \
+                }                                                           \
+            }                                                               \
+            scalarPiece(M, N, A, B, ii, iEnd, jEnd, j1);                    \
+            scalarPiece(M, N, A, B, iEnd, i1, jj, j1);                      \
+        }                                                                   \
+    }
+
+/**
+ * Blocked transpose of rows r0..r1-1 and columns c0..c1-1 of A, without
+ * SIMD
+ */
+static void scalarTiled(int M, int N, int A[N][M], int B[M][N], int r0,
+                        int r1, int c0, int c1) {
+    for (int ii = r0; ii < r1; ii += TILE) {
+        for (int jj = c0; jj < c1; jj += TILE) {
+            scalarPiece(M, N, A, B, ii, ii + TILE < r1 ? ii + TILE : r1, jj,
+                        jj + TILE < c1 ? jj + TILE : c1);
+        }
+    }
+}
+
+/**
+ * Blocked transpose without SIMD, the fallback
+ */
+void transposeScalar(int M, int N, int A[N][M], int B[M][N]) {
+    scalarTiled(M, N, A, B, 0, N, 0, M);
+}
+
+#ifdef HAVE_X86
+
+/**
+ * Transpose a 4 x 4 block with SSE2
+ */
+__attribute__((target("sse2"))) static inline void sse4x4(const int* a,
+                                                          int lda, int* b,
+                                                          int ldb) {
+    __m128i r0 = _mm_loadu_si128((const __m128i*)(a + 0 * lda));
+    __m128i r1 = _mm_loadu_si128((const __m128i*)(a + 1 * lda));
+    __m128i r2 = _mm_loadu_si128((const __m128i*)(a + 2 * lda));
+    __m128i r3 = _mm_loadu_si128((const __m128i*)(a + 3 * lda));
+
+    // pairs of rows interleaved: a00 a10 a01 a11, a02 a12 a03 a13, ...
+    __m128i t0 = _mm_unpacklo_epi32(r0, r1);
+    __m128i t1 = _mm_unpackhi_epi32(r0, r1);
+    __m128i t2 = _mm_unpacklo_epi32(r2, r3);
+    __m128i t3 = _mm_unpackhi_epi32(r2, r3);
+
+    _mm_storeu_si128((__m128i*)(b + 0 * ldb), _mm_unpacklo_epi64(t0, t2));
+    _mm_storeu_si128((__m128i*)(b + 1 * ldb), _mm_unpackhi_epi64(t0, t2));
+    _mm_storeu_si128((__m128i*)(b + 2 * ldb), _mm_unpacklo_epi64(t1, t3));
+    _mm_storeu_si128((__m128i*)(b + 3 * ldb), _mm_unpackhi_epi64(t1, t3));
+}
+
+/**
+ * Blocked transpose of 4 x 4 SSE2 blocks, of part of A
+ */
+__attribute__((target("sse2"))) static void sseTiled(int M, int N,
+                                                     int A[N][M],
+                                                     int B[M][N], int r0,
+                                                     int r1, int c0,
+                                                     int c1) {
+    TRANSPOSE_TILED(4, sse4x4)
+}
+
+/**
+ * Blocked transpose of 4 x 4 SSE2 blocks
+ */
+void transposeSse(int M, int N, int A[N][M], int B[M][N]) {
+    sseTiled(M, N, A, B, 0, N, 0, M);
+}
+
+/**
+ * Transpose an 8 x 8 block with AVX2
+ */
+__attribute__((target("avx2"))) static inline void avx8x8(const int* a,
+                                                          int lda, int* b,
+                                                          int ldb) {
+    __m256i r0 = _mm256_loadu_si256((const __m256i*)(a + 0 * lda));
+    __m256i r1 = _mm256_loadu_si256((const __m256i*)(a + 1 * lda));
+    __m256i r2 = _mm256_loadu_si256((const __m256i*)(a + 2 * lda));
+    __m256i r3 = _mm256_loadu_si256((const __m256i*)(a + 3 * lda));
+    __m256i r4 = _mm256_loadu_si256((const __m256i*)(a + 4 * lda));
+    __m256i r5 = _mm256_loadu_si256((const __m256i*)(a + 5 * lda));
+    __m256i r6 = _mm256_loadu_si256((const __m256i*)(a + 6 * lda));
+    __m256i r7 = _mm256_loadu_si256((const __m256i*)(a + 7 * lda));
+
+    // within each 128-bit lane, as in the 4 x 4 SSE2 kernel
+    __m256i t0 = _mm256_unpacklo_epi32(r0, r1);
+    __m256i t1 = _mm256_unpackhi_epi32(r0, r1);
+    __m256i t2 = _mm256_unpacklo_epi32(r2, r3);
+    __m256i t3 = _mm256_unpackhi_epi32(r2, r3);
+    __m256i t4 = _mm256_unpacklo_epi32(r4, r5);
+    __m256i t5 = _mm256_unpackhi_epi32(r4, r5);
+    __m256i t6 = _mm256_unpacklo_epi32(r6, r7);
+    __m256i t7 = _mm256_unpackhi_epi32(r6, r7);
+
+    __m256i u0 = _mm256_unpacklo_epi64(t0, t2);
+    __m256i u1 = _mm256_unpackhi_epi64(t0, t2);
+    __m256i u2 = _mm256_unpacklo_epi64(t1, t3);
+    __m256i u3 = _mm256_unpackhi_epi64(t1, t3);
+    __m256i u4 = _mm256_unpacklo_epi64(t4, t6);
+    __m256i u5 = _mm256_unpackhi_epi64(t4, t6);
+    __m256i u6 = _mm256_unpacklo_epi64(t5, t7);
+    __m256i u7 = _mm256_unpackhi_epi64(t5, t7);
+
+    // then swap lanes: low lanes of rows 0-3 meet those of rows 4-7
+    _mm256_storeu_si256((__m256i*)(b + 0 * ldb),
+                        _mm256_permute2x128_si256(u0, u4, 0x20));
+    _mm256_storeu_si256((__m256i*)(b + 1 * ldb),
+                        _mm256_permute2x128_si256(u1, u5, 0x20));
+    _mm256_storeu_si256((__m256i*)(b + 2 * ldb),
+                        _mm256_permute2x128_si256(u2, u6, 0x20));
+    _mm256_storeu_si256((__m256i*)(b + 3 * ldb),
+                        _mm256_permute2x128_si256(u3, u7, 0x20));
+    _mm256_storeu_si256((__m256i*)(b + 4 * ldb),
+                        _mm256_permute2x128_si256(u0, u4, 0x31));
+    _mm256_storeu_si256((__m256i*)(b + 5 * ldb),
+                        _mm256_permute2x128_si256(u1, u5, 0x31));
+    _mm256_storeu_si256((__m256i*)(b + 6 * ldb),
+                        _mm256_permute2x128_si256(u2, u6, 0x31));
+    _mm256_storeu_si256((__m256i*)(b + 7 * ldb),
+                        _mm256_permute2x128_si256(u3, u7, 0x31));
+}
+
+/**
+ * Blocked transpose of 8 x 8 AVX2 blocks, of part of A
+ */
+__attribute__((target("avx2"))) static void avx2Tiled(int M, int N,
+                                                      int A[N][M],
+                                                      int B[M][N], int r0,
+                                                      int r1, int c0,
+                                                      int c1) {
+    TRANSPOSE_TILED(8, avx8x8)
+}
+
+/**
+ * Blocked transpose of 8 x 8 AVX2 blocks
+ */
+void transposeAvx2(int M, int N, int A[N][M], int B[M][N]) {
+    avx2Tiled(M, N, A, B, 0, N, 0, M);
+}
+
+int cpuHasSse(void) {
+    return __builtin_cpu_supports("sse2");
+}
+
+int cpuHasAvx2(void) {
+    return __builtin_cpu_supports("avx2");
+}
+
+#else
+
+static void sseTiled(int M, int N, int A[N][M], int B[M][N], int r0,
+                     int r1, int c0, int c1) {
+    scalarTiled(M, N, A, B, r0, r1, c0, c1);
+}
+
+static void avx2Tiled(int M, int N, int A[N][M], int B[M][N], int r0,
+                      int r1, int c0, int c1) {
+    scalarTiled(M, N, A, B, r0, r1, c0, c1);
+}
+
+void transposeSse(int M, int N, int A[N][M], int B[M][N]) {
+    transposeScalar(M, N, A, B);
+}
+
+void transposeAvx2(int M, int N, int A[N][M], int B[M][N]) {
+    transposeScalar(M, N, A, B);
+}
+
+int cpuHasSse(void) {
+    return 0;
+}
+
+int cpuHasAvx2(void) {
+    return 0;
+}
+
+#endif /* HAVE_X86 */
+
+typedef void (*TiledFunc)(int M, int N, int A[N][M], int B[M][N], int r0,
+                          int r1, int c0, int c1);
+
+/**
+ * The best tiled transpose this CPU can run, and its name
+ */
+static TiledFunc pickTranspose(const char** name) {
+    if (cpuHasAvx2()) {
+        *name = "avx2";
+        return avx2Tiled;
+    }
+    if (cpuHasSse()) {
+        *name = "sse2";
+        return sseTiled;
+    }
+    *name = "scalar";
+    return scalarTiled;
+}
+
+/**
+ * Name of the kernel transposeFast uses on this CPU
+ */
+const char* transposeFastName(void) {
+    const char* name;
+
+    pickTranspose(&name);
+    return name;
+}
+
+/**
+ * Transpose rows r0..r1-1 and columns c0..c1-1 of A with the best kernel
+ * for this CPU, chosen on the first call
+ */
+void transposeFastPiece(int M, int N, int A[N][M], int B[M][N], int r0,
+                        int r1, int c0, int c1) {
+    static TiledFunc chosen = NULL;
+    const char* name;
+
+    if (chosen == NULL) {
+        chosen = pickTranspose(&name);
+    }
+    chosen(M, N, A, B, r0, r1, c0, c1);
+}
+
+/**
+ * Transpose with the best kernel for this CPU
+ */
+void transposeFast(int M, int N, int A[N][M], int B[M][N]) {
+    transposeFastPiece(M, N, A, B, 0, N, 0, M);
+}
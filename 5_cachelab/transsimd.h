@@ -0,0 +1,23 @@
+/**
+ * transsimd.h - Fast native transposes: SSE2 and AVX2 micro-kernels in
+ * cache-sized tiles, picked at run time by what the CPU supports
+ */
+
+#ifndef TRANSSIMD_H
+#define TRANSSIMD_H
+
+// same shape as the trans.c functions: B = A^T, A is N rows of M
+typedef void (*TransposeFunc)(int M, int N, int A[N][M], int B[M][N]);
+
+void transposeScalar(int M, int N, int A[N][M], int B[M][N]);
+void transposeSse(int M, int N, int A[N][M], int B[M][N]);
+void transposeAvx2(int M, int N, int A[N][M], int B[M][N]);
+void transposeFast(int M, int N, int A[N][M], int B[M][N]);
+void transposeFastPiece(int M, int N, int A[N][M], int B[M][N], int r0,
+                        int r1, int c0, int c1);
+
+int cpuHasSse(void);
+int cpuHasAvx2(void);
+const char* transposeFastName(void);
+
+#endif /* TRANSSIMD_H */
@@ -0,0 +1,414 @@
+/**
+ * transsuite.c - Benchmark every registered transpose across matrix shapes
+ * and cache geometries, and generate a dispatch table from the results
+ *
+ * trans.c is linked twice. trans-trace.o is instrumented for tracehook.c,
+ * and gives each function's hits, misses and evictions in each simulated
+ * cache. trans-native.o is built with -O2, and gives its run time on this
+ * machine; only its registerFunctions is left global, renamed
+ * registerNativeFunctions, so that the two copies do not clash. Both
+ * register the same functions in the same order.
+ *
+ * For each shape, prints a row per function: its misses in each cache and
+ * its native time per call, best of a few batches of calls. The fastest
+ * correct function for each shape wins, or with -m the one with the
+ * fewest misses in the given cache. With -o, the winners are written out
+ * as a C file defining transpose_dispatch, which calls the winner for
+ * each shape measured and, for other shapes, the function that won most.
+ *
+ * A and B are laid out as tracegen lays them out: B starts 256 x 256
+ * ints after A, or right after A if A is bigger; functions with wider
+ * elements than that leaves room for are skipped. In-place functions,
+ * called with B = A, and those registered with registerElemFunction,
+ * float included, are measured but never picked, since they are not
+ * drop-in replacements for the int transposes.
+ *
+ * Usage: ./transsuite [-h] [-c <s>,<E>,<b>]... [-m <n>] [-o <file>]
+ *            [<M>x<N> | <N>]...
+ */
+
+#define _GNU_SOURCE  // dladdr
+#include <dlfcn.h>
+#include <getopt.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "cachelab.h"
+#include "tracehook.h"
+
+#define MATRIX_BYTES (256 * 256 * 4)  // tracegen's static arrays
+#define MAX_GEOMETRIES 16
+#define BATCH_SECONDS 1e-3  // shortest batch of calls timed
+#define BATCHES 5
+
+extern trans_func_t func_list[MAX_TRANS_FUNCS];
+extern int func_counter;
+
+void registerFunctions();
+void registerNativeFunctions();
+
+typedef struct {
+    int s, E, b;
+} Geometry;
+
+Geometry geometries[MAX_GEOMETRIES];
+int nGeometries;
+int nFuncs;  // entries of func_list from each copy of trans.c
+
+void printUsage() {
+    printf(
+        "Usage: ./transsuite [-h] [-c <s>,<E>,<b>]... [-m <n>] [-o <file>]\n"
+        "                    [<M>x<N> | <N>]...\n"
+        "Options:\n"
+        "  -h         Print this help message.\n"
+        "  -c <s>,<E>,<b>  Add a cache to simulate (default 5,1,5, the\n"
+        "             lab's cache; 6,8,6, a 32 KB L1; and 10,16,6, a 1 MB\n"
+        "             L2).\n"
+        "  -m <n>     Pick the function with the fewest misses in the\n"
+        "             n-th cache, from 1, instead of the fastest.\n"
+        "  -o <file>  Write transpose_dispatch, calling the winner for\n"
+        "             each shape, to file.\n"
+        "Shapes are M columns by N rows of A, or N for N x N (default\n"
+        "32x32 64x64 61x67 128x128 256x256).\n\n"
+        "Examples:\n"
+        "  linux>  ./transsuite -o transdispatch.c\n"
+        "  linux>  ./transsuite -c 5,1,5 -m 1 32x32 64x64 61x67\n");
+}
+
+/**
+ * Seconds on a monotonic clock
+ */
+static double now() {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+/**
+ * Whether B holds the transpose of A, of elements of size bytes
+ */
+static int isTransposed(int M, int N, int size, const char* A,
+                        const char* B) {
+    for (size_t i = 0; i < (size_t)N; i++) {
+        for (size_t j = 0; j < (size_t)M; j++) {
+            if (memcmp(B + (j * N + i) * size, A + (i * M + j) * size,
+                       size)) {
+                return 0;
+            }
+        }
+    }
+    return 1;
+}
+
+/**
+ * Restore A from orig, then call a function once
+ * @return 0, or -1 if its result is wrong
+ */
+static int runOnce(int f, int M, int N, const int* orig, int* A, int* B) {
+    int* out = func_list[f].inplace ? A : B;
+    int size = func_list[f].elem_size;
+
+    memcpy(A, orig, (size_t)M * N * size);
+    if (out == B) {
+        memset(B, 0, (size_t)M * N * size);
+    }
+    func_list[f].func_ptr(M, N, (int(*)[M])A, (int(*)[N])out);
+    return isTransposed(M, N, size, (const char*)orig, (const char*)out)
+               ? 0
+               : -1;
+}
+
+/**
+ * Run a traced function once in a cache
+ * @param counts set to the hits, misses and evictions
+ * @return 0, or -1 if its result is wrong
+ */
+static int simulate(int f, const Geometry* g, int M, int N, const int* orig,
+                    int* A, int* B, TraceSink* counts) {
+    Cache cache;
+    TraceSink sink = {&cache, 0, 0, 0};
+    int result;
+
+    if (cacheInit(&cache, g->s, g->E, g->b) < 0) {
+        fprintf(stderr, "out of memory for the cache\n");
+        exit(-1);
+    }
+    traceInto(&sink);
+    result = runOnce(f, M, N, orig, A, B);
+    traceInto(NULL);
+    cacheFree(&cache);
+    *counts = sink;
+    return result;
+}
+
+/**
+ * Time a native function
+ * @return seconds per call, or a negative number if its result is wrong
+ */
+static double timeNative(int f, int M, int N, const int* orig, int* A,
+                         int* B) {
+    int* out = func_list[f].inplace ? A : B;
+    double best = 1e30;
+    long calls = 1;
+
+    if (runOnce(f, M, N, orig, A, B) < 0) {
+        return -1;
+    }
+    for (int k = 0; k < BATCHES; k++) {
+        double start = now(), elapsed;
+        for (long c = 0; c < calls; c++) {
+            func_list[f].func_ptr(M, N, (int(*)[M])A, (int(*)[N])out);
+        }
+        elapsed = now() - start;
+        if (elapsed < BATCH_SECONDS) {
+            // too short to time: grow the batch and try again
+            calls *= 2;
+            k--;
+            continue;
+        }
+        if (elapsed / calls < best) {
+            best = elapsed / calls;
+        }
+    }
+    return best;
+}
+
+/**
+ * Name of a trans.c function, which must be exported (-rdynamic)
+ */
+static const char* funcName(int f) {
+    Dl_info info;
+
+    if (dladdr((void*)func_list[f].func_ptr, &info) && info.dli_sname) {
+        return info.dli_sname;
+    }
+    return "?";
+}
+
+/**
+ * Write transpose_dispatch, which calls winners[k] for shape k
+ */
+static void writeDispatch(const char* path, int argc, char* argv[],
+                          int nShapes, const int* Ms, const int* Ns,
+                          const int* winners, const double* times) {
+    FILE* out = fopen(path, "w");
+    int wins[MAX_TRANS_FUNCS] = {0}, fallback = -1;
+
+    if (out == NULL) {
+        perror(path);
+        exit(-1);
+    }
+    for (int k = 0; k < nShapes; k++) {
+        if (winners[k] < 0) {
+            continue;
+        }
+        wins[winners[k]]++;
+        if (fallback < 0 || wins[winners[k]] > wins[fallback]) {
+            fallback = winners[k];
+        }
+    }
+    if (fallback < 0) {
+        fprintf(stderr, "no function transposed correctly\n");
+        exit(-1);
+    }
+
+    fprintf(out, "/*\n * %s - Generated by", path);
+    for (int k = 0; k < argc; k++) {
+        fprintf(out, " %s", argv[k]);
+    }
+    fprintf(out, "\n *     Do not edit: link it with trans.c and call or "
+            "register\n *     transpose_dispatch.\n */\n"
+            "#include \"cachelab.h\"\n\n");
+    for (int f = 0; f < nFuncs; f++) {
+        if (wins[f] > 0 || f == fallback) {
+            fprintf(out, "void %s(int M, int N, int A[N][M], int B[M][N]);\n",
+                    funcName(f));
+        }
+    }
+    fprintf(out, "\n/* transpose_dispatch - The best trans.c function for "
+            "each shape */\n"
+            "char transpose_dispatch_desc[] = \"Dispatched by shape\";\n"
+            "void transpose_dispatch(int M, int N, int A[N][M], "
+            "int B[M][N])\n{\n");
+    for (int k = 0, first = 1; k < nShapes; k++) {
+        if (winners[k] >= 0) {
+            fprintf(out, "    %sif (M == %d && N == %d)\n"
+                    "        %s(M, N, A, B);  /* %.2f us */\n",
+                    first ? "" : "else ", Ms[k], Ns[k],
+                    funcName(winners[k]), times[k] * 1e6);
+            first = 0;
+        }
+    }
+    fprintf(out, "    else\n        %s(M, N, A, B);\n}\n",
+            funcName(fallback));
+    fclose(out);
+}
+
+int main(int argc, char* argv[]) {
+    static char* defaults[] = {"32x32", "64x64", "61x67", "128x128",
+                               "256x256"};
+    char** shapes = defaults;
+    char* outPath = NULL;
+    int nShapes = 5, byMisses = 0, opt;
+    int *Ms, *Ns, *winners;
+    double* winnerTimes;
+
+    while ((opt = getopt(argc, argv, "hc:m:o:")) != -1) {
+        switch (opt) {
+            case 'c': {
+                Geometry* g = &geometries[nGeometries];
+                if (nGeometries == MAX_GEOMETRIES ||
+                    sscanf(optarg, "%d,%d,%d", &g->s, &g->E, &g->b) != 3 ||
+                    g->s < 0 || g->E < 1 || g->b < 0 || g->s + g->b > 40) {
+                    fprintf(stderr, "bad cache: %s\n", optarg);
+                    exit(-1);
+                }
+                nGeometries++;
+                break;
+            }
+            case 'm':
+                byMisses = atoi(optarg);
+                break;
+            case 'o':
+                outPath = optarg;
+                break;
+            default:
+                printUsage();
+                exit(opt == 'h' ? 0 : -1);
+        }
+    }
+    if (nGeometries == 0) {
+        geometries[nGeometries++] = (Geometry){5, 1, 5};
+        geometries[nGeometries++] = (Geometry){6, 8, 6};
+        geometries[nGeometries++] = (Geometry){10, 16, 6};
+    }
+    if (byMisses < 0 || byMisses > nGeometries) {
+        printUsage();
+        exit(-1);
+    }
+    if (optind < argc) {
+        shapes = argv + optind;
+        nShapes = argc - optind;
+    }
+
+    registerFunctions();
+    nFuncs = func_counter;
+    registerNativeFunctions();
+    if (func_counter != 2 * nFuncs) {
+        fprintf(stderr, "trans.c registered its functions differently "
+                "twice\n");
+        exit(-1);
+    }
+
+    Ms = malloc(nShapes * sizeof(int));
+    Ns = malloc(nShapes * sizeof(int));
+    winners = malloc(nShapes * sizeof(int));
+    winnerTimes = malloc(nShapes * sizeof(double));
+    if (Ms == NULL || Ns == NULL || winners == NULL || winnerTimes == NULL) {
+        exit(-1);
+    }
+
+    for (int k = 0; k < nShapes; k++) {
+        int M, N;
+        size_t span;
+        char* base;
+        int *A, *B, *orig;
+        double bestTime = 1e30;
+        unsigned long bestMisses = ULONG_MAX;
+
+        if (sscanf(shapes[k], "%dx%d", &M, &N) == 1) {
+            N = M;
+        }
+        if (M <= 0 || N <= 0) {
+            fprintf(stderr, "bad shape: %s\n", shapes[k]);
+            exit(-1);
+        }
+        span = (size_t)M * N * sizeof(int);
+        span = span < MATRIX_BYTES ? MATRIX_BYTES
+                                   : (span + MATRIX_BYTES - 1) /
+                                         MATRIX_BYTES * MATRIX_BYTES;
+        if (posix_memalign((void**)&base, MATRIX_BYTES, 2 * span) != 0) {
+            fprintf(stderr, "out of memory for %s\n", shapes[k]);
+            exit(-1);
+        }
+        A = (int*)base;
+        B = (int*)(base + span);
+        orig = malloc(span);
+        if (orig == NULL) {
+            fprintf(stderr, "out of memory for %s\n", shapes[k]);
+            exit(-1);
+        }
+        randMatrix(span / sizeof(int), 1, (int(*)[span / sizeof(int)])A);
+        initMatrix(M, N, (int(*)[M])A, (int(*)[N])B);
+        memcpy(orig, A, span);
+        Ms[k] = M;
+        Ns[k] = N;
+        winners[k] = -1;
+
+        printf("%dx%d%*s", M, N, 40 - snprintf(NULL, 0, "%dx%d", M, N), "");
+        for (int c = 0; c < nGeometries; c++) {
+            char name[32];
+            snprintf(name, sizeof(name), "%d,%d,%d", geometries[c].s,
+                     geometries[c].E, geometries[c].b);
+            printf(" %10s", name);
+        }
+        printf(" %10s\n", "us/call");
+
+        for (int f = 0; f < nFuncs; f++) {
+            unsigned long misses = 0;
+            double t;
+            int correct;
+
+            printf("  %-38.38s", func_list[f].description);
+            if ((size_t)M * N * func_list[f].elem_size > span) {
+                printf(" does not fit\n");
+                continue;
+            }
+            t = timeNative(nFuncs + f, M, N, orig, A, B);
+            correct = t >= 0;
+            for (int c = 0; c < nGeometries; c++) {
+                TraceSink counts;
+                if (simulate(f, &geometries[c], M, N, orig, A, B,
+                             &counts) < 0) {
+                    correct = 0;
+                }
+                printf(" %10lu", counts.misses);
+                if (c == byMisses - 1) {
+                    misses = counts.misses;
+                }
+            }
+            if (!correct) {
+                printf(" %10s\n", "wrong");
+                continue;
+            }
+            printf(" %10.2f\n", t * 1e6);
+            if (func_list[f].inplace || func_list[f].elem_typed) {
+                continue;
+            }
+            if (byMisses ? misses < bestMisses : t < bestTime) {
+                bestMisses = misses;
+                bestTime = t;
+                winners[k] = f;
+                winnerTimes[k] = t;
+            }
+        }
+        if (winners[k] >= 0) {
+            printf("  best: %s\n", funcName(winners[k]));
+        }
+        free(base);
+        free(orig);
+    }
+
+    if (outPath != NULL) {
+        writeDispatch(outPath, argc, argv, nShapes, Ms, Ns, winners,
+                      winnerTimes);
+    }
+    free(Ms);
+    free(Ns);
+    free(winners);
+    free(winnerTimes);
+    return 0;
+}
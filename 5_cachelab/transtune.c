@@ -0,0 +1,207 @@
+/**
+ * transtune.c - Choose trans.c's blocked transpose tiles for a cache
+ *
+ * For each matrix shape, replays the accesses of trans_blocked for every
+ * tile of up to 32 x 32 elements through a cachemodel cache, and prints
+ * the tile with the fewest misses as a line for tuned_tile in trans.c.
+ * The misses of the recursive cache-oblivious transpose and of 8 x 8
+ * tiles are printed alongside for comparison.
+ *
+ * The access order here must follow trans_tile, trans_blocked and
+ * trans_rec in trans.c: A is read a tile row at a time, each element
+ * stored to B at once, except on the diagonal, where the store waits
+ * for the end of the row.
+ *
+ * A and B are laid out as tracegen lays them out: A[N][M] at the start
+ * of a 256 x 256 int array and B[M][N] at the start of the next one, or
+ * at the addresses in tracegen's .regions file with -a.
+ *
+ * Usage: ./transtune [-h] -s <num> -E <num> -b <num> [-a <file>]
+ *            [-t <max>] <M>x<N>...
+ */
+
+#include <getopt.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "cachemodel.h"
+#include "classify.h"
+
+#define MATRIX_BYTES (256 * 256 * 4)  // tracegen's static arrays
+#define REC_BASE 8                    // as in trans.c
+
+Cache cache;
+unsigned long baseA = 0x100000, baseB = 0x100000 + MATRIX_BYTES;
+int M, N;
+unsigned long misses;
+
+void printUsage() {
+    printf(
+        "Usage: ./transtune [-h] -s <num> -E <num> -b <num> [-a <file>]\n"
+        "                   [-t <max>] <M>x<N>...\n"
+        "Options:\n"
+        "  -h         Print this help message.\n"
+        "  -s <num>   Number of set index bits.\n"
+        "  -E <num>   Number of lines per set.\n"
+        "  -b <num>   Number of block offset bits.\n"
+        "  -a <file>  Take the addresses of A and B from tracegen's\n"
+        "             .regions file.\n"
+        "  -t <max>   Largest tile side to try (default 32).\n\n"
+        "Examples:\n"
+        "  linux>  ./transtune -s 5 -E 1 -b 5 61x67 48x48\n");
+}
+
+/**
+ * Simulate one load or store of an int
+ */
+static void touch(unsigned long address) {
+    if (cacheAccess(&cache, address, 0, NULL) != CACHE_HIT) {
+        misses++;
+    }
+}
+
+#define A_AT(i, j) (baseA + 4 * ((unsigned long)(i) * M + (j)))
+#define B_AT(j, i) (baseB + 4 * ((unsigned long)(j) * N + (i)))
+
+/**
+ * Replay trans_tile: rows i0..i1-1, columns j0..j1-1 of A
+ */
+static void replayTile(int i0, int i1, int j0, int j1) {
+    for (int i = i0; i < i1; i++) {
+        int diag = -1;
+        for (int j = j0; j < j1; j++) {
+            touch(A_AT(i, j));
+            if (i == j) {
+                diag = i;
+            } else {
+                touch(B_AT(j, i));
+            }
+        }
+        if (diag >= 0) {
+            touch(B_AT(diag, diag));
+        }
+    }
+}
+
+/**
+ * Replay trans_rec
+ */
+static void replayRecursive(int i0, int i1, int j0, int j1) {
+    if (i1 - i0 <= REC_BASE && j1 - j0 <= REC_BASE) {
+        replayTile(i0, i1, j0, j1);
+    } else if (i1 - i0 >= j1 - j0) {
+        int mid = i0 + (i1 - i0) / 2;
+        replayRecursive(i0, mid, j0, j1);
+        replayRecursive(mid, i1, j0, j1);
+    } else {
+        int mid = j0 + (j1 - j0) / 2;
+        replayRecursive(i0, i1, j0, mid);
+        replayRecursive(i0, i1, mid, j1);
+    }
+}
+
+/**
+ * Empty the cache and the miss count
+ */
+static void resetCache() {
+    int s = cache.s, E = cache.E, b = cache.b;
+
+    cacheFree(&cache);
+    if (cacheInit(&cache, s, E, b) < 0) {
+        exit(-1);
+    }
+    misses = 0;
+}
+
+/**
+ * Misses of trans_blocked with the given tile
+ */
+static unsigned long blockedMisses(int rows, int cols) {
+    resetCache();
+    for (int i = 0; i < N; i += rows) {
+        for (int j = 0; j < M; j += cols) {
+            replayTile(i, i + rows < N ? i + rows : N, j,
+                       j + cols < M ? j + cols : M);
+        }
+    }
+    return misses;
+}
+
+int main(int argc, char* argv[]) {
+    int s = -1, E = 0, b = -1, maxTile = 32, opt;
+
+    while ((opt = getopt(argc, argv, "hs:E:b:a:t:")) != -1) {
+        switch (opt) {
+            case 's':
+                s = atoi(optarg);
+                break;
+            case 'E':
+                E = atoi(optarg);
+                break;
+            case 'b':
+                b = atoi(optarg);
+                break;
+            case 'a': {
+                Region* regions;
+                int n = loadRegions(optarg, &regions);
+                if (n < 0) {
+                    exit(-1);
+                }
+                for (int i = 0; i < n; i++) {
+                    if (!strcmp(regions[i].name, "A")) {
+                        baseA = regions[i].start;
+                    } else if (!strcmp(regions[i].name, "B")) {
+                        baseB = regions[i].start;
+                    }
+                }
+                free(regions);
+                break;
+            }
+            case 't':
+                maxTile = atoi(optarg);
+                break;
+            default:
+                printUsage();
+                exit(opt == 'h' ? 0 : -1);
+        }
+    }
+    if (cacheInit(&cache, s, E, b) < 0 || maxTile < 1 || optind == argc) {
+        printUsage();
+        exit(-1);
+    }
+
+    printf("/* ./transtune -s %d -E %d -b %d: shape, best tile, misses; "
+           "8x8 and recursive misses */\n", s, E, b);
+    for (int k = optind; k < argc; k++) {
+        unsigned long best = ULONG_MAX, square, recursive;
+        int bestRows = 0, bestCols = 0;
+
+        if (sscanf(argv[k], "%dx%d", &M, &N) != 2 || M <= 0 || N <= 0 ||
+            M > 256 || N > 256) {
+            fprintf(stderr, "bad shape: %s\n", argv[k]);
+            exit(-1);
+        }
+        for (int rows = 1; rows <= maxTile && rows <= N; rows++) {
+            for (int cols = 1; cols <= maxTile && cols <= M; cols++) {
+                unsigned long m = blockedMisses(rows, cols);
+                if (m < best) {
+                    best = m;
+                    bestRows = rows;
+                    bestCols = cols;
+                }
+            }
+        }
+        square = blockedMisses(8, 8);
+        resetCache();
+        replayRecursive(0, N, 0, M);
+        recursive = misses;
+        printf("    if (M == %d && N == %d) {\n"
+               "        return TILE(%d, %d);  // %lu misses; 8x8 %lu, "
+               "recursive %lu\n"
+               "    }\n",
+               M, N, bestRows, bestCols, best, square, recursive);
+    }
+    cacheFree(&cache);
+    return 0;
+}
@@ -18,6 +18,16 @@
 /* $begin csapp.c */
 #include "csapp.h"
 
+#ifdef __linux__
+#include <sys/sendfile.h>
+/* Declared by <fcntl.h> only under _GNU_SOURCE, which csapp.h cannot use */
+extern ssize_t splice(int fd_in, off_t *off_in, int fd_out, off_t *off_out,
+                      size_t len, unsigned int flags);
+#endif
+#ifndef IOV_MAX
+#define IOV_MAX 1024
+#endif
+
 /************************** 
  * Error-handling functions
  **************************/
@@ -865,40 +875,274 @@ ssize_t rio_readnb(rio_t *rp, void *usrbuf, size_t n)
 }
 /* $end rio_readnb */
 
-/* 
- * rio_readlineb - Robustly read a text line (buffered)
+/*
+ * rio_fill - Move the unread bytes to the front of the internal buffer
+ *    and read() more after them. Returns the number of bytes added, 0 on
+ *    EOF or if the buffer is already full, and -1 on error.
+ */
+/* $begin rio_fill */
+static ssize_t rio_fill(rio_t *rp)
+{
+    ssize_t nread;
+
+    if (rp->rio_cnt <= 0)
+        rp->rio_cnt = 0;
+    else if (rp->rio_bufptr != rp->rio_buf)
+        memmove(rp->rio_buf, rp->rio_bufptr, rp->rio_cnt);
+    rp->rio_bufptr = rp->rio_buf;
+    if (rp->rio_cnt == sizeof(rp->rio_buf))
+        return 0;
+
+    while ((nread = read(rp->rio_fd, rp->rio_buf + rp->rio_cnt,
+                         sizeof(rp->rio_buf) - rp->rio_cnt)) < 0)
+    {
+        if (errno != EINTR) /* Interrupted by sig handler return */
+            return -1;
+    }
+    rp->rio_cnt += nread;
+    return nread;
+}
+/* $end rio_fill */
+
+/*
+ * rio_readlineb - Robustly read a text line (buffered). Each refill of
+ *     the internal buffer is scanned for the newline with memchr() and
+ *     copied out in one piece, rather than a byte at a time.
  */
 /* $begin rio_readlineb */
 ssize_t rio_readlineb(rio_t *rp, void *usrbuf, size_t maxlen)
 {
-    int n, rc;
-    char c, *bufp = usrbuf;
+    size_t n = 0, cnt;
+    ssize_t rc;
+    char *bufp = usrbuf, *nl = NULL;
 
-    for (n = 1; n < maxlen; n++)
+    if (maxlen == 0)
+        return 0;
+    while (nl == NULL && n < maxlen - 1)
     {
-        if ((rc = rio_read(rp, &c, 1)) == 1)
+        if (rp->rio_cnt <= 0)
         {
-            *bufp++ = c;
-            if (c == '\n')
-            {
-                n++;
+            if ((rc = rio_fill(rp)) < 0)
+                return -1;     /* Error */
+            else if (rc == 0)
+                break;         /* EOF */
+        }
+        cnt = maxlen - 1 - n;
+        if (rp->rio_cnt < cnt)
+            cnt = rp->rio_cnt;
+        if ((nl = memchr(rp->rio_bufptr, '\n', cnt)) != NULL)
+            cnt = nl - rp->rio_bufptr + 1;
+        memcpy(bufp + n, rp->rio_bufptr, cnt);
+        rp->rio_bufptr += cnt;
+        rp->rio_cnt -= cnt;
+        n += cnt;
+    }
+    bufp[n] = '\0';
+    return n;
+}
+/* $end rio_readlineb */
+
+/*
+ * rio_peeklineb - Return the next text line in place: *linep points at
+ *     it inside the internal buffer (not NUL-terminated) and stays valid
+ *     until the next read from rp. A line longer than RIO_BUFSIZE comes
+ *     back in RIO_BUFSIZE pieces, as with rio_readlineb. Returns the
+ *     line length, 0 on EOF, and -1 on error.
+ */
+/* $begin rio_peeklineb */
+ssize_t rio_peeklineb(rio_t *rp, char **linep)
+{
+    int scanned = 0, cnt;
+    ssize_t rc;
+    char *nl;
+
+    for (;;)
+    {
+        if (rp->rio_cnt > scanned)
+        {
+            nl = memchr(rp->rio_bufptr + scanned, '\n', rp->rio_cnt - scanned);
+            if (nl != NULL)
                 break;
-            }
+            scanned = rp->rio_cnt;
         }
-        else if (rc == 0)
+        if ((rc = rio_fill(rp)) < 0)
+            return -1;
+        else if (rc == 0) /* EOF or full buffer: return what we have */
         {
-            if (n == 1)
-                return 0; /* EOF, no data read */
-            else
-                break; /* EOF, some data was read */
+            nl = rp->rio_bufptr + rp->rio_cnt - 1;
+            break;
         }
+    }
+    cnt = nl - rp->rio_bufptr + 1;
+    *linep = rp->rio_bufptr;
+    rp->rio_bufptr += cnt;
+    rp->rio_cnt -= cnt;
+    return cnt;
+}
+/* $end rio_peeklineb */
+
+/*
+ * rio_writev - Robustly write a gather list of buffers (unbuffered).
+ *     Partial writes advance the caller's iov array in place.
+ */
+/* $begin rio_writev */
+ssize_t rio_writev(int fd, struct iovec *iov, int iovcnt)
+{
+    size_t n = 0;
+    ssize_t nwritten;
+    int i;
+
+    for (i = 0; i < iovcnt; i++)
+        n += iov[i].iov_len;
+    while (iovcnt > 0)
+    {
+        /* Skip empty buffers: a writev() of only those returns 0 */
+        if (iov->iov_len == 0)
+        {
+            iov++;
+            iovcnt--;
+            continue;
+        }
+        if (iovcnt > IOV_MAX)
+            i = IOV_MAX;
         else
-            return -1; /* Error */
+            i = iovcnt;
+        if ((nwritten = writev(fd, iov, i)) < 0)
+        {
+            if (errno == EINTR)  /* Interrupted by sig handler return */
+                nwritten = 0;    /* and call writev() again */
+            else
+                return -1;       /* errno set by writev() */
+        }
+        /* Skip the buffers that went out, then trim the partial one */
+        while (iovcnt > 0 && nwritten >= iov->iov_len)
+        {
+            nwritten -= iov->iov_len;
+            iov++;
+            iovcnt--;
+        }
+        if (iovcnt > 0)
+        {
+            iov->iov_base = (char *)iov->iov_base + nwritten;
+            iov->iov_len -= nwritten;
+        }
     }
-    *bufp = 0;
-    return n - 1;
+    return n;
 }
-/* $end rio_readlineb */
+/* $end rio_writev */
+
+/*
+ * rio_writeinitb - Associate a descriptor with a write buffer
+ */
+/* $begin rio_writeinitb */
+void rio_writeinitb(rio_writer_t *wp, int fd)
+{
+    wp->rio_fd = fd;
+    wp->rio_cnt = 0;
+}
+/* $end rio_writeinitb */
+
+/*
+ * rio_flushb - Write out whatever is pending in the write buffer
+ */
+/* $begin rio_flushb */
+ssize_t rio_flushb(rio_writer_t *wp)
+{
+    ssize_t n = wp->rio_cnt;
+
+    if (n > 0 && rio_writen(wp->rio_fd, wp->rio_buf, n) != n)
+        return -1;
+    wp->rio_cnt = 0;
+    return n;
+}
+/* $end rio_flushb */
+
+/*
+ * rio_writenb - Robustly write n bytes (buffered). Small writes are
+ *     collected in the internal buffer; one that does not fit goes out
+ *     together with the pending bytes in a single writev().
+ */
+/* $begin rio_writenb */
+ssize_t rio_writenb(rio_writer_t *wp, void *usrbuf, size_t n)
+{
+    struct iovec iov[2];
+
+    if (n <= RIO_BUFSIZE - wp->rio_cnt)
+    {
+        memcpy(wp->rio_buf + wp->rio_cnt, usrbuf, n);
+        wp->rio_cnt += n;
+        return n;
+    }
+    iov[0].iov_base = wp->rio_buf;
+    iov[0].iov_len = wp->rio_cnt;
+    iov[1].iov_base = usrbuf;
+    iov[1].iov_len = n;
+    if (rio_writev(wp->rio_fd, iov, 2) < 0)
+        return -1;
+    wp->rio_cnt = 0;
+    return n;
+}
+/* $end rio_writenb */
+
+/*
+ * rio_copy - Copy everything up to EOF from fd_in to fd_out, returning
+ *     the number of bytes copied. On Linux the data moves in the kernel
+ *     with sendfile() (file to anything) or splice() (either end a pipe),
+ *     falling back to read()/write() through a user buffer.
+ */
+/* $begin rio_copy */
+ssize_t rio_copy(int fd_in, int fd_out)
+{
+    size_t n = 0;
+    ssize_t nread;
+    char buf[RIO_BUFSIZE];
+
+#ifdef __linux__
+    /* Try sendfile(), then splice(); either may not apply to these fds */
+    while ((nread = sendfile(fd_out, fd_in, NULL, RIO_COPYMAX)) != 0)
+    {
+        if (nread < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            if (n == 0 && (errno == EINVAL || errno == ENOSYS))
+                break;
+            return -1;
+        }
+        n += nread;
+    }
+    if (nread == 0)
+        return n;
+    while ((nread = splice(fd_in, NULL, fd_out, NULL, RIO_COPYMAX, 0)) != 0)
+    {
+        if (nread < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            if (n == 0 && errno == EINVAL)
+                break;
+            return -1;
+        }
+        n += nread;
+    }
+    if (nread == 0)
+        return n;
+#endif
+    while ((nread = read(fd_in, buf, sizeof(buf))) != 0)
+    {
+        if (nread < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            return -1;
+        }
+        if (rio_writen(fd_out, buf, nread) != nread)
+            return -1;
+        n += nread;
+    }
+    return n;
+}
+/* $end rio_copy */
 
 /**********************************
  * Wrappers for robust I/O routines
@@ -941,6 +1185,56 @@ ssize_t Rio_readlineb(rio_t *rp, void *usrbuf, size_t maxlen)
     return rc;
 }
 
+ssize_t Rio_peeklineb(rio_t *rp, char **linep)
+{
+    ssize_t rc;
+
+    if ((rc = rio_peeklineb(rp, linep)) < 0)
+        unix_error("Rio_peeklineb error");
+    return rc;
+}
+
+ssize_t Rio_writev(int fd, struct iovec *iov, int iovcnt)
+{
+    ssize_t rc;
+
+    if ((rc = rio_writev(fd, iov, iovcnt)) < 0)
+        unix_error("Rio_writev error");
+    return rc;
+}
+
+void Rio_writeinitb(rio_writer_t *wp, int fd)
+{
+    rio_writeinitb(wp, fd);
+}
+
+ssize_t Rio_writenb(rio_writer_t *wp, void *usrbuf, size_t n)
+{
+    ssize_t rc;
+
+    if ((rc = rio_writenb(wp, usrbuf, n)) < 0)
+        unix_error("Rio_writenb error");
+    return rc;
+}
+
+ssize_t Rio_flushb(rio_writer_t *wp)
+{
+    ssize_t rc;
+
+    if ((rc = rio_flushb(wp)) < 0)
+        unix_error("Rio_flushb error");
+    return rc;
+}
+
+ssize_t Rio_copy(int fd_in, int fd_out)
+{
+    ssize_t rc;
+
+    if ((rc = rio_copy(fd_in, fd_out)) < 0)
+        unix_error("Rio_copy error");
+    return rc;
+}
+
 /******************************** 
  * Client/server helper functions
  ********************************/
@@ -66,6 +66,7 @@ void doit(int clientfd) {
     char buf[MAXLINE], cacheline[MAX_OBJECT_SIZE];
     char request[MAXLINE];
     rio_t rio_client, rio_server;
+    rio_writer_t rio_out;
     size_t n, size = 0;
     uri_t parsed_uri;
 
@@ -107,13 +108,22 @@ void doit(int clientfd) {
     Rio_readinitb(&rio_server, serverfd);
     Rio_writen(serverfd, request, strlen(request));
 
-    /* Forward response to client */
+    /* Forward response to client, batching the lines into few writes */
     memset(buf, 0, sizeof(buf));
-    while ((n = Rio_readlineb(&rio_server, buf, MAXLINE))) {
-        Rio_writen(clientfd, buf, n);
+    Rio_writeinitb(&rio_out, clientfd);
+    while (1) {
+        /* Flush before a read that may block, so that a response the
+           server trickles out still reaches the client as it arrives */
+        if (rio_server.rio_cnt == 0 ||
+            !memchr(rio_server.rio_bufptr, '\n', rio_server.rio_cnt))
+            Rio_flushb(&rio_out);
+        if ((n = Rio_readlineb(&rio_server, buf, MAXLINE)) == 0)
+            break;
+        Rio_writenb(&rio_out, buf, n);
         if ((size += n) <= MAX_OBJECT_SIZE) /* in case of buffer overflow */
             memcpy(cacheline + size - n, buf, n);
     }
+    Rio_flushb(&rio_out);
 
     /* Write response to cache */
     cache_write(&cache, uri, cacheline, size);
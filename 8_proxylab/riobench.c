@@ -0,0 +1,122 @@
+/*
+ * riobench.c - Header-parsing throughput of the Rio line readers
+ * Usage: ./riobench [megabytes]
+ *
+ * Writes a stream of browser-like HTTP requests to a temporary file and
+ * reads it back line by line with
+ * - bytewise: the old rio_readlineb loop, one buffered byte per call
+ * - readlineb: rio_readlineb, which scans the buffer with memchr
+ * - peeklineb: rio_peeklineb, which also skips the copy out
+ * reporting MB/s and lines/s for each.
+ */
+
+#include "csapp.h"
+
+#define DEFAULT_MB 64
+#define ROUNDS 3 /* best of */
+
+static const char* request =
+    "GET http://www.cmu.edu/hub/index.html HTTP/1.1\r\n"
+    "Host: www.cmu.edu\r\n"
+    "User-Agent: Mozilla/5.0 (X11; Linux x86_64; rv:10.0.3) "
+    "Gecko/20120305 Firefox/10.0.3\r\n"
+    "Accept: text/html,application/xhtml+xml,application/xml;q=0.9,"
+    "*/*;q=0.8\r\n"
+    "Accept-Language: en-US,en;q=0.5\r\n"
+    "Accept-Encoding: gzip, deflate\r\n"
+    "Referer: http://www.cmu.edu/\r\n"
+    "Cookie: session=0123456789abcdef; theme=light\r\n"
+    "Connection: keep-alive\r\n"
+    "Proxy-Connection: keep-alive\r\n"
+    "Cache-Control: max-age=0\r\n"
+    "\r\n";
+
+/*
+ * readline_bytewise - rio_readlineb before memchr, one rio_readnb call
+ *     (and so one memcpy) per byte
+ */
+static ssize_t readline_bytewise(rio_t* rp, char* usrbuf, size_t maxlen) {
+    int n, rc;
+    char c, *bufp = usrbuf;
+
+    for (n = 1; n < maxlen; n++) {
+        if ((rc = rio_readnb(rp, &c, 1)) == 1) {
+            *bufp++ = c;
+            if (c == '\n') {
+                n++;
+                break;
+            }
+        } else if (rc == 0) {
+            if (n == 1)
+                return 0;
+            break;
+        } else
+            return -1;
+    }
+    *bufp = 0;
+    return n - 1;
+}
+
+/*
+ * run - read the whole file with one reader, returning seconds taken
+ */
+static double run(int fd, int reader, size_t* bytes, size_t* lines) {
+    rio_t rio;
+    char buf[MAXLINE], *line;
+    struct timeval start, end;
+    ssize_t n;
+
+    Lseek(fd, 0, SEEK_SET);
+    Rio_readinitb(&rio, fd);
+    *bytes = *lines = 0;
+    gettimeofday(&start, NULL);
+    for (;;) {
+        if (reader == 0)
+            n = readline_bytewise(&rio, buf, MAXLINE);
+        else if (reader == 1)
+            n = Rio_readlineb(&rio, buf, MAXLINE);
+        else
+            n = Rio_peeklineb(&rio, &line);
+        if (n <= 0)
+            break;
+        *bytes += n;
+        (*lines)++;
+    }
+    gettimeofday(&end, NULL);
+    return (end.tv_sec - start.tv_sec) + (end.tv_usec - start.tv_usec) / 1e6;
+}
+
+int main(int argc, char** argv) {
+    static const char* names[] = {"bytewise", "readlineb", "peeklineb"};
+    char path[] = "/tmp/riobenchXXXXXX";
+    rio_writer_t out;
+    size_t size, len = strlen(request), total, bytes, lines;
+    double t, best;
+    int fd, reader, round;
+
+    size = (argc > 1 ? atoi(argv[1]) : DEFAULT_MB) * (1 << 20);
+    if ((fd = mkstemp(path)) < 0)
+        unix_error("mkstemp error");
+    unlink(path);
+    Rio_writeinitb(&out, fd);
+    for (total = 0; total < size; total += len)
+        Rio_writenb(&out, (void*)request, len);
+    Rio_flushb(&out);
+
+    printf("%zu MB of requests, %zu-byte request\n", total >> 20, len);
+    printf("%-10s %10s %12s\n", "reader", "MB/s", "Mlines/s");
+    for (reader = 0; reader < 3; reader++) {
+        best = 0;
+        for (round = 0; round < ROUNDS; round++) {
+            t = run(fd, reader, &bytes, &lines);
+            if (bytes != total)
+                app_error("short read");
+            if (round == 0 || t < best)
+                best = t;
+        }
+        printf("%-10s %10.1f %12.2f\n", names[reader],
+               bytes / best / (1 << 20), lines / best / 1e6);
+    }
+    Close(fd);
+    return 0;
+}
@@ -16,6 +16,8 @@
 #include <sys/stat.h>
 #include <fcntl.h>
 #include <sys/mman.h>
+#include <sys/uio.h>
+#include <limits.h>
 #include <errno.h>
 #include <math.h>
 #include <pthread.h>
@@ -47,6 +49,16 @@ typedef struct {
 } rio_t;
 /* $end rio_t */
 
+/* Persistent state for buffered Rio writes */
+/* $begin rio_writer_t */
+typedef struct {
+    int rio_fd;                /* Descriptor for this internal buf */
+    int rio_cnt;               /* Unflushed bytes in internal buf */
+    char rio_buf[RIO_BUFSIZE]; /* Internal buffer */
+} rio_writer_t;
+/* $end rio_writer_t */
+#define RIO_COPYMAX 0x7ffff000 /* Most bytes one sendfile()/splice() moves */
+
 /* External variables */
 extern int h_errno;    /* Defined by BIND for DNS errors */ 
 extern char **environ; /* Defined by libc */
@@ -174,6 +186,12 @@ ssize_t rio_writen(int fd, void *usrbuf, size_t n);
 void rio_readinitb(rio_t *rp, int fd); 
 ssize_t	rio_readnb(rio_t *rp, void *usrbuf, size_t n);
 ssize_t	rio_readlineb(rio_t *rp, void *usrbuf, size_t maxlen);
+ssize_t rio_peeklineb(rio_t *rp, char **linep);
+ssize_t rio_writev(int fd, struct iovec *iov, int iovcnt);
+void rio_writeinitb(rio_writer_t *wp, int fd);
+ssize_t rio_writenb(rio_writer_t *wp, void *usrbuf, size_t n);
+ssize_t rio_flushb(rio_writer_t *wp);
+ssize_t rio_copy(int fd_in, int fd_out);
 
 /* Wrappers for Rio package */
 ssize_t Rio_readn(int fd, void *usrbuf, size_t n);
@@ -181,6 +199,12 @@ void Rio_writen(int fd, void *usrbuf, size_t n);
 void Rio_readinitb(rio_t *rp, int fd); 
 ssize_t Rio_readnb(rio_t *rp, void *usrbuf, size_t n);
 ssize_t Rio_readlineb(rio_t *rp, void *usrbuf, size_t maxlen);
+ssize_t Rio_peeklineb(rio_t *rp, char **linep);
+ssize_t Rio_writev(int fd, struct iovec *iov, int iovcnt);
+void Rio_writeinitb(rio_writer_t *wp, int fd);
+ssize_t Rio_writenb(rio_writer_t *wp, void *usrbuf, size_t n);
+ssize_t Rio_flushb(rio_writer_t *wp);
+ssize_t Rio_copy(int fd_in, int fd_out);
 
 /* Reentrant protocol-independent client/server helpers */
 int open_clientfd(char *hostname, char *port);
@@ -0,0 +1,332 @@
+/*
+ * docindex.c - In-memory index of the document root
+ *
+ * With -i, Tiny walks its document root once at startup and records the
+ * size, modification time and a strong ETag (FNV-1a hash of the
+ * contents) of every regular file. Conditional GETs (If-None-Match,
+ * If-Modified-Since) can then be answered with 304 from the index alone,
+ * and every response carries validators so that caches downstream can
+ * revalidate cheaply.
+ *
+ * The index follows changes to the tree through inotify: each directory
+ * is watched, and an event on a name re-indexes (or drops) just that
+ * entry. The servers drain the (non-blocking) inotify descriptor before
+ * each lookup, so a response never uses validators older than the last
+ * completed write to the file.
+ */
+#include "docindex.h"
+#include <sys/inotify.h>
+
+#define DI_MINBUCKETS 1024
+#define DI_EVENTS (IN_CLOSE_WRITE | IN_CREATE | IN_DELETE | IN_MOVED_FROM | \
+                   IN_MOVED_TO | IN_ATTRIB)
+
+static docent_t **buckets;
+static size_t nbuckets, nentries;
+static int infd = -1;
+static char *root;
+static char **wdpaths;          /* Directory path of each watch */
+static int nwd;
+
+/*
+ * fnv1a - 64-bit FNV-1a hash of a buffer, continuing from h
+ */
+static unsigned long long fnv1a(unsigned long long h, const void *buf,
+                                size_t n)
+{
+    const unsigned char *p = buf;
+
+    while (n--) {
+        h ^= *p++;
+        h *= 0x100000001b3ULL;
+    }
+    return h;
+}
+
+#define FNV_BASIS 0xcbf29ce484222325ULL
+
+static docent_t **slot(char *path)
+{
+    docent_t **pp = &buckets[fnv1a(FNV_BASIS, path, strlen(path)) &
+                             (nbuckets - 1)];
+
+    while (*pp && strcmp((*pp)->path, path))
+        pp = &(*pp)->next;
+    return pp;
+}
+
+/*
+ * grow - double the bucket array when chains get long
+ */
+static void grow(void)
+{
+    docent_t **old = buckets, *e, *next;
+    size_t i, n = nbuckets;
+
+    nbuckets = n ? 2 * n : DI_MINBUCKETS;
+    buckets = Calloc(nbuckets, sizeof(docent_t *));
+    for (i = 0; i < n; i++) {
+        for (e = old[i]; e; e = next) {
+            next = e->next;
+            e->next = NULL;
+            *slot(e->path) = e;
+        }
+    }
+    free(old);
+}
+
+static void drop(char *path)
+{
+    docent_t **pp = slot(path), *e = *pp;
+
+    if (e) {
+        *pp = e->next;
+        free(e->path);
+        free(e);
+        nentries--;
+    }
+}
+
+/*
+ * drop_tree - forget every entry under a directory (all of them if
+ *     dir is NULL)
+ */
+static void drop_tree(char *dir)
+{
+    docent_t **pp;
+    size_t i, len = dir ? strlen(dir) : 0;
+
+    for (i = 0; i < nbuckets; i++) {
+        pp = &buckets[i];
+        while (*pp) {
+            if (!dir || (!strncmp((*pp)->path, dir, len) &&
+                         (*pp)->path[len] == '/'))
+                drop((*pp)->path);
+            else
+                pp = &(*pp)->next;
+        }
+    }
+}
+
+/*
+ * index_file - (re)compute the entry for one path. Anything that is not
+ *     a readable regular file is dropped from the index.
+ */
+static void index_file(char *path)
+{
+    struct stat sb;
+    docent_t **pp, *e;
+    unsigned long long h = FNV_BASIS;
+    char buf[MAXBUF];
+    ssize_t n;
+    int fd;
+
+    if ((fd = open(path, O_RDONLY)) < 0 || fstat(fd, &sb) < 0 ||
+        !S_ISREG(sb.st_mode)) {
+        if (fd >= 0)
+            close(fd);
+        drop(path);
+        return;
+    }
+    while ((n = read(fd, buf, sizeof(buf))) > 0)
+        h = fnv1a(h, buf, n);
+    close(fd);
+
+    if (nentries >= 2 * nbuckets)
+        grow();
+    if ((e = *(pp = slot(path))) == NULL) {
+        e = Malloc(sizeof(docent_t));
+        e->path = strdup(path);
+        e->next = NULL;
+        *pp = e;
+        nentries++;
+    }
+    e->size = sb.st_size;
+    e->mtime = sb.st_mtime;
+    sprintf(e->etag, "\"%016llx\"", h);
+}
+
+/*
+ * index_dir - index a directory tree and watch every directory in it
+ */
+static void index_dir(char *dir)
+{
+    char path[MAXLINE];
+    struct dirent *de;
+    struct stat sb;
+    DIR *dp;
+    int wd;
+
+    if (infd >= 0 && (wd = inotify_add_watch(infd, dir, DI_EVENTS)) >= 0) {
+        if (wd >= nwd) {
+            wdpaths = Realloc(wdpaths, (wd + 1) * sizeof(char *));
+            memset(wdpaths + nwd, 0, (wd + 1 - nwd) * sizeof(char *));
+            nwd = wd + 1;
+        }
+        free(wdpaths[wd]);
+        wdpaths[wd] = strdup(dir);
+    }
+
+    if ((dp = opendir(dir)) == NULL)
+        return;
+    while ((de = readdir(dp)) != NULL) {
+        if (!strcmp(de->d_name, ".") || !strcmp(de->d_name, ".."))
+            continue;
+        if (snprintf(path, sizeof(path), "%s/%s", dir, de->d_name) >=
+            sizeof(path) || lstat(path, &sb) < 0)
+            continue;
+        if (S_ISDIR(sb.st_mode))
+            index_dir(path);
+        else if (S_ISREG(sb.st_mode))
+            index_file(path);
+    }
+    closedir(dp);
+}
+
+/*
+ * docindex_init - index the tree under root ("." for Tiny). Returns the
+ *     number of files indexed.
+ */
+int docindex_init(char *dir)
+{
+    root = dir;
+    if ((infd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC)) < 0)
+        fprintf(stderr, "inotify unavailable, index will not refresh: %s\n",
+                strerror(errno));
+    grow();
+    index_dir(root);
+    return nentries;
+}
+
+/*
+ * docindex_refresh - apply pending inotify events to the index
+ */
+void docindex_refresh(void)
+{
+    char buf[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+    char path[MAXLINE];
+    struct inotify_event *ev;
+    ssize_t n;
+    char *p;
+
+    if (infd < 0)
+        return;
+    while ((n = read(infd, buf, sizeof(buf))) > 0) {
+        for (p = buf; p < buf + n; p += sizeof(*ev) + ev->len) {
+            ev = (struct inotify_event *)p;
+            if (ev->mask & IN_Q_OVERFLOW) {
+                /* Lost events: start over */
+                fprintf(stderr, "inotify queue overflow, reindexing\n");
+                drop_tree(NULL);
+                index_dir(root);
+                continue;
+            }
+            if (ev->wd >= nwd || !wdpaths[ev->wd] || !ev->len)
+                continue;
+            if (snprintf(path, sizeof(path), "%s/%s", wdpaths[ev->wd],
+                         ev->name) >= sizeof(path))
+                continue;
+            if (!(ev->mask & IN_ISDIR))
+                index_file(path);
+            else if (ev->mask & (IN_CREATE | IN_MOVED_TO))
+                index_dir(path);
+            else if (ev->mask & (IN_DELETE | IN_MOVED_FROM))
+                drop_tree(path);
+        }
+    }
+}
+
+/*
+ * docindex_lookup - find the entry for a filename built by parse_uri
+ */
+docent_t *docindex_lookup(char *filename)
+{
+    return buckets ? *slot(filename) : NULL;
+}
+
+/*
+ * find_header - return the value of a request header, or NULL
+ */
+static char *find_header(char *headers, char *name)
+{
+    size_t len = strlen(name);
+    char *p = headers;
+
+    while (p && *p) {
+        if (!strncasecmp(p, name, len) && p[len] == ':')
+            return p + len + 1 + strspn(p + len + 1, " \t");
+        if ((p = strchr(p, '\n')) != NULL)
+            p++;
+    }
+    return NULL;
+}
+
+/*
+ * parse_httpdate - parse an RFC 1123 date ("Sun, 06 Nov 1994 08:49:37
+ *     GMT"), returning -1 if it is malformed
+ */
+static time_t parse_httpdate(char *s)
+{
+    static const char *months = "JanFebMarAprMayJunJulAugSepOctNovDec";
+    char mon[4];
+    const char *m;
+    struct tm tm;
+
+    memset(&tm, 0, sizeof(tm));
+    if (sscanf(s, "%*3s, %d %3s %d %d:%d:%d GMT", &tm.tm_mday, mon,
+               &tm.tm_year, &tm.tm_hour, &tm.tm_min, &tm.tm_sec) != 6 ||
+        (m = strstr(months, mon)) == NULL || (m - months) % 3)
+        return -1;
+    tm.tm_mon = (m - months) / 3;
+    tm.tm_year -= 1900;
+    return timegm(&tm);
+}
+
+/*
+ * docindex_fresh - does the client's cached copy still match the entry?
+ *     If-None-Match takes precedence over If-Modified-Since (RFC 7232).
+ */
+int docindex_fresh(docent_t *e, char *headers)
+{
+    char *v, *tag;
+    size_t len;
+    time_t since;
+
+    if ((v = find_header(headers, "If-None-Match")) != NULL) {
+        for (tag = v; *tag && *tag != '\r' && *tag != '\n'; tag += len) {
+            tag += strspn(tag, ", \t");
+            len = strcspn(tag, ", \t\r\n");
+            if (len == 1 && *tag == '*')
+                return 1;
+            /* Weak comparison: a W/ prefix does not matter here */
+            if (!strncmp(tag, "W/", 2) && len == strlen(e->etag) + 2 &&
+                !strncmp(tag + 2, e->etag, len - 2))
+                return 1;
+            if (len == strlen(e->etag) && !strncmp(tag, e->etag, len))
+                return 1;
+        }
+        return 0;
+    }
+    if ((v = find_header(headers, "If-Modified-Since")) != NULL &&
+        (since = parse_httpdate(v)) != -1)
+        return e->mtime <= since;
+    return 0;
+}
+
+/*
+ * format_validators - write the ETag, Last-Modified and Cache-Control
+ *     header lines for an entry into buf, returning their length
+ */
+int format_validators(char *buf, size_t size, docent_t *e)
+{
+    char date[64];
+    struct tm tm;
+    int n;
+
+    gmtime_r(&e->mtime, &tm);
+    strftime(date, sizeof(date), "%a, %d %b %Y %H:%M:%S GMT", &tm);
+    n = snprintf(buf, size, "ETag: %s\r\n"
+                 "Last-Modified: %s\r\n"
+                 "Cache-Control: no-cache\r\n", e->etag, date);
+    return n < size ? n : size - 1;
+}
@@ -0,0 +1,23 @@
+/*
+ * docindex.h - In-memory index of the document root with cache validators
+ */
+#ifndef __DOCINDEX_H__
+#define __DOCINDEX_H__
+
+#include "csapp.h"
+
+typedef struct docent {
+    char *path;                 /* "./dir/file", as built by parse_uri */
+    off_t size;
+    time_t mtime;
+    char etag[24];              /* Quoted strong ETag (content hash) */
+    struct docent *next;        /* Hash chain */
+} docent_t;
+
+int docindex_init(char *root);
+void docindex_refresh(void);
+docent_t *docindex_lookup(char *filename);
+int docindex_fresh(docent_t *e, char *headers);
+int format_validators(char *buf, size_t size, docent_t *e);
+
+#endif /* __DOCINDEX_H__ */
@@ -0,0 +1,610 @@
+/*
+ * evloop.c - A single-process, event-driven mode for Tiny
+ *
+ * All sockets are non-blocking and multiplexed with epoll. Requests are
+ * accumulated incrementally until the blank line that ends the headers,
+ * so a client that connects and never finishes its request only holds
+ * a connection slot until its read deadline expires; it never blocks
+ * other clients. Static files are sent with non-blocking sendfile,
+ * resuming on EPOLLOUT. CGI programs write into a pipe that is watched
+ * like any other descriptor, and their output is relayed to the client
+ * (chunked when the connection is persistent).
+ *
+ * Connections are kept alive as in the iterative server. Requests that
+ * arrive pipelined stay in the request buffer and are answered in order
+ * once the previous response has been sent.
+ *
+ * Each connection sits on one deadline list per state (idle, reading,
+ * writing). Every activity moves it to the tail, so each list stays
+ * sorted by deadline and expiring connections are found at its head.
+ */
+#include "tiny.h"
+#include <sys/epoll.h>
+#include <sys/sendfile.h>
+#include <time.h>
+
+/* Only declared under _GNU_SOURCE, which clashes with csapp's gai_error */
+extern int accept4(int sockfd, struct sockaddr *addr, socklen_t *addrlen,
+                   int flags);
+extern int pipe2(int pipefd[2], int flags);
+
+#define EV_MAXEVENTS     256
+#define EV_READ_TIMEOUT  10000  /* ms allowed to receive a full request */
+#define EV_WRITE_TIMEOUT 30000  /* ms allowed between send progress */
+
+typedef enum {
+    CONN_IDLE, CONN_READING, CONN_WRITING, CONN_NSTATES
+} conn_state_t;
+
+typedef struct conn {
+    int fd;
+    conn_state_t state;
+    int nreq;                   /* Requests started on this connection */
+    int keep;                   /* Keep it open after this response */
+    char req[MAXLINE];          /* Request bytes received so far */
+    size_t reqlen;
+    size_t reqend;              /* End of the request being answered */
+    char out[2 * MAXBUF];       /* Pending headers, error or CGI data */
+    size_t outlen, outoff;
+    int filefd;                 /* File being sent, -1 if none */
+    off_t fileoff;
+    size_t filesize;
+    int cgifd;                  /* CGI output pipe, -1 if none */
+    int chunked;                /* Frame CGI output as chunks */
+    int cgibody;                /* CGI headers have been relayed */
+    char *cgibuf;               /* CGI output not yet relayed */
+    size_t cgilen;
+    uint32_t sockev, cgiev;     /* Events currently watched */
+    long deadline;              /* Monotonic ms */
+    struct conn *prev, *next;   /* Deadline list links */
+} conn_t;
+
+typedef struct {
+    conn_t *head, *tail;
+} conn_list_t;
+
+static int epfd;
+static conn_list_t lists[CONN_NSTATES];
+static const long timeouts[CONN_NSTATES] = {
+    KEEPALIVE_TIMEOUT * 1000, EV_READ_TIMEOUT, EV_WRITE_TIMEOUT
+};
+static conn_t *dead;            /* Closed this round, freed after it */
+
+/*
+ * now_ms - current monotonic time in milliseconds
+ */
+static long now_ms(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000L + ts.tv_nsec / 1000000L;
+}
+
+static void list_remove(conn_list_t *l, conn_t *c)
+{
+    if (c->prev) c->prev->next = c->next; else l->head = c->next;
+    if (c->next) c->next->prev = c->prev; else l->tail = c->prev;
+    c->prev = c->next = NULL;
+}
+
+static void list_append(conn_list_t *l, conn_t *c)
+{
+    c->prev = l->tail;
+    c->next = NULL;
+    if (l->tail) l->tail->next = c; else l->head = c;
+    l->tail = c;
+}
+
+/*
+ * conn_touch - push back the deadline after progress or a state change
+ */
+static void conn_touch(conn_t *c, conn_state_t state)
+{
+    list_remove(&lists[c->state], c);
+    c->state = state;
+    c->deadline = now_ms() + timeouts[state];
+    list_append(&lists[state], c);
+}
+
+/*
+ * conn_close - close a connection. The memory is released only after
+ *     the current batch of events, which may still refer to it.
+ */
+static void conn_close(conn_t *c)
+{
+    list_remove(&lists[c->state], c);
+    if (c->filefd >= 0)
+        close(c->filefd);
+    if (c->cgifd >= 0)
+        close(c->cgifd);
+    free(c->cgibuf);
+    close(c->fd);               /* Also removes it from the epoll set */
+    c->fd = -1;
+    c->next = dead;
+    dead = c;
+}
+
+/*
+ * watch - set the events epoll reports for one of a connection's fds.
+ *     Both the client socket and the CGI pipe report the connection
+ *     itself, so an fd we are not waiting on is removed from the set
+ *     entirely rather than left to report hangups.
+ */
+static void watch(int fd, conn_t *c, uint32_t *cur, uint32_t events)
+{
+    struct epoll_event ev;
+    int op;
+
+    if (*cur == events)
+        return;
+    op = !*cur ? EPOLL_CTL_ADD : !events ? EPOLL_CTL_DEL : EPOLL_CTL_MOD;
+    *cur = events;
+    ev.events = events;
+    ev.data.ptr = c;
+    if (epoll_ctl(epfd, op, fd, &ev) < 0)
+        unix_error("epoll_ctl error");
+}
+
+static void watch_sock(conn_t *c, uint32_t events)
+{
+    watch(c->fd, c, &c->sockev, events);
+}
+
+static void watch_cgi(conn_t *c, uint32_t events)
+{
+    watch(c->cgifd, c, &c->cgiev, events);
+}
+
+/*
+ * accept_all - accept every pending connection on the listening socket
+ */
+static void accept_all(int listenfd)
+{
+    int fd;
+    conn_t *c;
+
+    while ((fd = accept4(listenfd, NULL, NULL,
+                         SOCK_NONBLOCK | SOCK_CLOEXEC)) >= 0) {
+        if ((c = malloc(sizeof(conn_t))) == NULL) {
+            close(fd);
+            continue;
+        }
+        c->fd = fd;
+        c->state = CONN_IDLE;
+        c->nreq = c->keep = 0;
+        c->reqlen = c->reqend = c->outlen = c->outoff = 0;
+        c->filefd = c->cgifd = -1;
+        c->cgibuf = NULL;
+        c->sockev = 0;
+        c->prev = c->next = NULL;
+        /* The idle timeout, like every other entry on the idle list */
+        c->deadline = now_ms() + timeouts[CONN_IDLE];
+        list_append(&lists[CONN_IDLE], c);
+        watch_sock(c, EPOLLIN);
+    }
+    /* EMFILE and friends: leave the rest in the backlog for later */
+    if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)
+        fprintf(stderr, "accept4 error: %s\n", strerror(errno));
+}
+
+/*
+ * start_error - queue an error response and switch to writing
+ */
+static void start_error(conn_t *c, int keep, char *cause, char *errnum,
+                        char *shortmsg, char *longmsg)
+{
+    c->keep = keep;
+    c->outlen = format_error(c->out, sizeof(c->out), keep, cause, errnum,
+                             shortmsg, longmsg);
+    c->outoff = 0;
+    conn_touch(c, CONN_WRITING);
+}
+
+/*
+ * start_dynamic - run a CGI program with its stdout on a pipe
+ */
+static void start_dynamic(conn_t *c, char *filename, char *cgiargs,
+                          char *headers, int chunked)
+{
+    int pfd[2];
+    char *emptylist[] = { NULL };
+    pid_t pid;
+
+    if ((c->cgibuf = malloc(MAXBUF)) == NULL || pipe2(pfd, O_CLOEXEC) < 0) {
+        start_error(c, 0, filename, "500", "Internal Server Error",
+                    "Tiny couldn't start the CGI program");
+        return;
+    }
+    fflush(stdout);             /* Don't let the child repeat our log */
+    if ((pid = fork()) < 0) {
+        close(pfd[0]);
+        close(pfd[1]);
+        start_error(c, 0, filename, "500", "Internal Server Error",
+                    "Tiny couldn't fork the CGI process");
+        return;
+    }
+    if (pid == 0) { /* Child */
+        setenv("QUERY_STRING", cgiargs, 1);
+        setenv("REQUEST_HEADERS", headers, 1);
+        dup2(pfd[1], STDOUT_FILENO);
+        execve(filename, emptylist, environ);
+        exit(1);
+    }
+    close(pfd[1]);              /* Parent; SIGCHLD reaps the child */
+    fcntl(pfd[0], F_SETFL, O_NONBLOCK);
+    c->cgifd = pfd[0];
+    c->chunked = chunked;
+    c->cgibody = 0;
+    c->cgilen = 0;
+    c->cgiev = 0;
+    conn_touch(c, CONN_WRITING);
+}
+
+/*
+ * start_request - parse the complete request at the front of the
+ *     buffer and set up its response
+ */
+static void start_request(conn_t *c)
+{
+    char method[MAXLINE], uri[MAXLINE], version[MAXLINE];
+    char filename[MAXLINE], cgiargs[MAXLINE], filetype[MAXLINE];
+    char *headers, saved;
+    struct stat sbuf;
+    docent_t *e;
+    int is_static, keep;
+
+    /* Hide any pipelined requests behind this one while we look at it */
+    saved = c->req[c->reqend];
+    c->req[c->reqend] = '\0';
+    c->nreq++;
+
+    if ((headers = strstr(c->req, "\r\n")) == NULL) {
+        start_error(c, 0, "request line", "400", "Bad Request",
+                    "Tiny couldn't find the end of the request line");
+        goto done;
+    }
+    headers += 2;
+    printf("%.*s", (int)(headers - c->req), c->req);
+    if (sscanf(c->req, "%s %s %s", method, uri, version) != 3) {
+        start_error(c, 0, c->req, "400", "Bad Request",
+                    "Tiny couldn't parse the request");
+        goto done;
+    }
+    if (strcasecmp(method, "GET")) {
+        start_error(c, 0, method, "501", "Not Implemented",
+                    "Tiny does not implement this method");
+        goto done;
+    }
+    keep = c->nreq < KEEPALIVE_MAX && request_keepalive(version, headers);
+
+    is_static = parse_uri(uri, filename, cgiargs);
+    if (is_static && (e = fresh_entry(filename, headers))) {
+        c->keep = keep;
+        c->outoff = 0;
+        c->outlen = format_not_modified(c->out, sizeof(c->out), e, keep);
+        conn_touch(c, CONN_WRITING);
+        goto done;
+    }
+    if (stat(filename, &sbuf) < 0) {
+        start_error(c, keep, filename, "404", "Not found",
+                    "Tiny couldn't find this file");
+        goto done;
+    }
+
+    if (!is_static) {
+        if (!(S_ISREG(sbuf.st_mode)) || !(S_IXUSR & sbuf.st_mode)) {
+            start_error(c, keep, filename, "403", "Forbidden",
+                        "Tiny couldn't run the CGI program");
+            goto done;
+        }
+        /* Without chunked framing, only EOF can end the body */
+        c->keep = keep && !strcasecmp(version, "HTTP/1.1");
+        start_dynamic(c, filename, cgiargs, headers, c->keep);
+        goto done;
+    }
+
+    if (!(S_ISREG(sbuf.st_mode)) || !(S_IRUSR & sbuf.st_mode) ||
+        (c->filefd = open(filename, O_RDONLY | O_CLOEXEC)) < 0) {
+        start_error(c, keep, filename, "403", "Forbidden",
+                    "Tiny couldn't read the file");
+        goto done;
+    }
+    get_filetype(filename, filetype);
+    c->keep = keep;
+    c->fileoff = 0;
+    c->filesize = sbuf.st_size;
+    c->outoff = 0;
+    c->outlen = format_static_header(c->out, sizeof(c->out), filetype,
+                                     c->filesize, keep,
+                                     index_entry(filename, &sbuf));
+    conn_touch(c, CONN_WRITING);
+
+ done:
+    c->req[c->reqend] = saved;
+}
+
+/*
+ * find_request - if a complete request is buffered, start answering it
+ */
+static void find_request(conn_t *c, size_t scan)
+{
+    char *end = strstr(c->req + scan, "\r\n\r\n");
+
+    if (end) {
+        c->reqend = end + 4 - c->req;
+        start_request(c);
+    } else if (c->reqlen == sizeof(c->req) - 1) {
+        c->reqend = c->reqlen;
+        start_error(c, 0, "request too long", "431",
+                    "Request Header Fields Too Large",
+                    "Tiny limits request headers to one buffer");
+    } else if (c->reqlen > 0 && c->state == CONN_IDLE) {
+        conn_touch(c, CONN_READING);
+    }
+}
+
+/*
+ * handle_read - read what is available and look for the end of the
+ *     request headers. Returns 0 if the connection was closed.
+ */
+static int handle_read(conn_t *c)
+{
+    ssize_t n;
+    size_t scan;
+
+    while (c->state != CONN_WRITING && c->reqlen < sizeof(c->req) - 1) {
+        n = read(c->fd, c->req + c->reqlen, sizeof(c->req) - 1 - c->reqlen);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n < 0 && errno == EAGAIN)
+            return 1;           /* Wait for more */
+        if (n <= 0) {
+            conn_close(c);      /* EOF or error before a full request */
+            return 0;
+        }
+
+        /* A NUL would hide the rest of the request from the parser */
+        if (memchr(c->req + c->reqlen, '\0', n)) {
+            c->reqlen += n;
+            c->reqend = c->reqlen;
+            start_error(c, 0, "NUL byte", "400", "Bad Request",
+                        "Tiny doesn't accept NUL bytes in requests");
+            return 1;
+        }
+
+        /* Only rescan the new bytes (plus a possible split terminator) */
+        scan = c->reqlen > 3 ? c->reqlen - 3 : 0;
+        c->reqlen += n;
+        c->req[c->reqlen] = '\0';
+        find_request(c, scan);
+    }
+    return 1;
+}
+
+/*
+ * relay_cgi - move CGI output into the out buffer, framing it as a
+ *     chunk if needed. Returns 1 if out has data or the CGI is done,
+ *     0 if the CGI has nothing for us yet, -1 if its output is bad.
+ */
+static int relay_cgi(conn_t *c)
+{
+    char *end;
+    ssize_t n;
+    size_t len;
+
+    if (c->cgilen == 0 || !c->cgibody) {
+        n = read(c->cgifd, c->cgibuf + c->cgilen, MAXBUF - 1 - c->cgilen);
+        if (n < 0)
+            return errno == EAGAIN || errno == EINTR ? 0 : -1;
+        if (n == 0) {           /* CGI finished */
+            close(c->cgifd);
+            c->cgifd = -1;
+            c->cgiev = 0;
+            if (!c->cgibody)
+                return -1;
+            c->outoff = 0;
+            c->outlen = c->chunked ? sprintf(c->out, "0\r\n\r\n") : 0;
+            return 1;
+        }
+        c->cgilen += n;
+    }
+
+    c->outoff = c->outlen = 0;
+    if (!c->cgibody) {
+        c->cgibuf[c->cgilen] = '\0';
+        if ((end = strstr(c->cgibuf, "\r\n\r\n")) == NULL)
+            return c->cgilen < MAXBUF - 1 ? 0 : -1;
+        end[2] = '\0';
+        c->outlen = format_cgi_header(c->out, sizeof(c->out), c->cgibuf,
+                                      c->chunked, c->keep);
+        c->cgibody = 1;
+        end += 4;
+        c->cgilen -= end - c->cgibuf;
+        memmove(c->cgibuf, end, c->cgilen);
+        if (c->cgilen == 0)
+            return 1;
+    }
+
+    /* Leave room for the chunk framing */
+    len = sizeof(c->out) - c->outlen - 32;
+    if (len > c->cgilen)
+        len = c->cgilen;
+    if (c->chunked)
+        c->outlen += sprintf(c->out + c->outlen, "%zx\r\n", len);
+    memcpy(c->out + c->outlen, c->cgibuf, len);
+    c->outlen += len;
+    if (c->chunked)
+        c->outlen += sprintf(c->out + c->outlen, "\r\n");
+    c->cgilen -= len;
+    memmove(c->cgibuf, c->cgibuf + len, c->cgilen);
+    return 1;
+}
+
+/*
+ * finish_response - close the connection or get ready for the next
+ *     request. Returns 0 if the connection was closed.
+ */
+static int finish_response(conn_t *c)
+{
+    if (c->filefd >= 0) {
+        close(c->filefd);
+        c->filefd = -1;
+    }
+    free(c->cgibuf);
+    c->cgibuf = NULL;
+    if (!c->keep) {
+        conn_close(c);
+        return 0;
+    }
+
+    /* Keep whatever the client pipelined after this request */
+    c->reqlen -= c->reqend;
+    memmove(c->req, c->req + c->reqend, c->reqlen + 1);
+    c->reqend = 0;
+    c->outlen = c->outoff = 0;
+    conn_touch(c, CONN_IDLE);
+    watch_sock(c, EPOLLIN);
+    find_request(c, 0);
+    return 1;
+}
+
+/*
+ * handle_write - push the response out as far as the socket and the
+ *     CGI pipe allow. Returns 0 if the connection was closed.
+ */
+static int handle_write(conn_t *c)
+{
+    ssize_t n;
+    int progress = 0, r;
+
+    while (c->state == CONN_WRITING) {
+        while (c->outoff < c->outlen) {
+            n = write(c->fd, c->out + c->outoff, c->outlen - c->outoff);
+            if (n < 0 && errno == EINTR)
+                continue;
+            if (n < 0 && errno == EAGAIN)
+                goto blocked;
+            if (n < 0) {
+                conn_close(c);
+                return 0;
+            }
+            c->outoff += n;
+            progress = 1;
+        }
+
+        while (c->filefd >= 0 && c->fileoff < c->filesize) {
+            n = sendfile(c->fd, c->filefd, &c->fileoff,
+                         c->filesize - c->fileoff);
+            if (n < 0 && errno == EINTR)
+                continue;
+            if (n < 0 && errno == EAGAIN)
+                goto blocked;
+            if (n <= 0) {       /* Error, or the file shrank under us */
+                conn_close(c);
+                return 0;
+            }
+            progress = 1;
+        }
+
+        if (c->cgifd >= 0) {
+            if ((r = relay_cgi(c)) < 0) {
+                conn_close(c);
+                return 0;
+            }
+            if (r == 0) {       /* Wait for the CGI, not the client */
+                watch_sock(c, 0);
+                watch_cgi(c, EPOLLIN);
+                goto waiting;
+            }
+            continue;
+        }
+
+        if (!finish_response(c))
+            return 0;
+    }
+    return 1;
+
+ blocked:
+    watch_sock(c, EPOLLOUT);
+    if (c->cgifd >= 0)
+        watch_cgi(c, 0);
+ waiting:
+    if (progress)
+        conn_touch(c, CONN_WRITING);
+    return 1;
+}
+
+/*
+ * expire - close connections whose deadline has passed and return the
+ *     epoll timeout until the next one (-1 if none)
+ */
+static int expire(void)
+{
+    long now = now_ms(), next = -1;
+    conn_t *c;
+    int i;
+
+    for (i = 0; i < CONN_NSTATES; i++) {
+        while ((c = lists[i].head) != NULL && c->deadline <= now)
+            conn_close(c);
+        if (c && (next < 0 || c->deadline - now < next))
+            next = c->deadline - now;
+    }
+    return (int)next;
+}
+
+/*
+ * reap - free the connections closed during the last round
+ */
+static void reap(void)
+{
+    conn_t *c;
+
+    while ((c = dead) != NULL) {
+        dead = c->next;
+        free(c);
+    }
+}
+
+/*
+ * event_loop - serve forever on a non-blocking listening socket
+ */
+void event_loop(int listenfd)
+{
+    struct epoll_event ev, events[EV_MAXEVENTS];
+    conn_t *c;
+    int i, n;
+
+    fcntl(listenfd, F_SETFL, fcntl(listenfd, F_GETFL) | O_NONBLOCK);
+    if ((epfd = epoll_create1(EPOLL_CLOEXEC)) < 0)
+        unix_error("epoll_create1 error");
+    ev.events = EPOLLIN;
+    ev.data.ptr = NULL;         /* NULL marks the listening socket */
+    if (epoll_ctl(epfd, EPOLL_CTL_ADD, listenfd, &ev) < 0)
+        unix_error("epoll_ctl error");
+
+    while (1) {
+        n = epoll_wait(epfd, events, EV_MAXEVENTS, expire());
+        reap();
+        if (n < 0) {
+            if (errno == EINTR)
+                continue;
+            unix_error("epoll_wait error");
+        }
+        for (i = 0; i < n; i++) {
+            if ((c = events[i].data.ptr) == NULL) {
+                accept_all(listenfd);
+                continue;
+            }
+            if (c->fd < 0)      /* Closed earlier in this round */
+                continue;
+            if (c->state != CONN_WRITING && !handle_read(c))
+                continue;
+            if (c->state == CONN_WRITING)
+                handle_write(c);
+        }
+        reap();
+        fflush(stdout);
+    }
+}
@@ -1,18 +1,27 @@
 /* $begin tinymain */
 /*
- * tiny.c - A simple, iterative HTTP/1.0 Web server that uses the 
+ * tiny.c - A simple, iterative HTTP/1.1 Web server that uses the 
  *     GET method to serve static and dynamic content.
+ *
+ *     Connections are persistent when the client asks for it: static
+ *     responses are framed by Content-length, dynamic ones by chunked
+ *     encoding, and pipelined requests are answered in order.
+ *
+ *     With -e, Tiny instead runs a single-process epoll event loop
+ *     (see evloop.c) that survives slow or idle clients. With -i, it
+ *     indexes the document root (see docindex.c) to answer conditional
+ *     requests with 304 and to send cache validators.
  */
-#include "csapp.h"
+#include "tiny.h"
+#include <poll.h>
 
-void doit(int fd);
-void read_requesthdrs(rio_t *rp, char *req_header_buf);
-int parse_uri(char *uri, char *filename, char *cgiargs);
-void serve_static(int fd, char *filename, int filesize);
-void get_filetype(char *filename, char *filetype);
-void serve_dynamic(int fd, char *filename, char *cgiargs, char *headers);
-void clienterror(int fd, char *cause, char *errnum, 
-		 char *shortmsg, char *longmsg);
+void serve_conn(int listenfd, int fd);
+int doit(int fd, rio_t *rp, int may_keep);
+int read_requesthdrs(rio_t *rp, char *req_header_buf);
+void serve_static(int fd, char *filename, int filesize, int keep,
+                  docent_t *e);
+int serve_dynamic_chunked(int fd, char *filename, char *cgiargs,
+                          char *headers);
 
 void sigchld_handler(int sig) { // reap all children
     int bkp_errno = errno;
@@ -25,104 +34,203 @@ int main(int argc, char **argv)
     signal(SIGPIPE, SIG_IGN);
     signal(SIGCHLD, sigchld_handler);
 
-    int listenfd, connfd;
+    int listenfd, connfd, opt, evented = 0, indexed = 0;
     char hostname[MAXLINE], port[MAXLINE];
     socklen_t clientlen;
     struct sockaddr_storage clientaddr;
 
     /* Check command line args */
-    if (argc != 2) {
-	fprintf(stderr, "usage: %s <port>\n", argv[0]);
+    while ((opt = getopt(argc, argv, "ei")) != -1) {
+        switch (opt) {
+        case 'e':
+            evented = 1;
+            break;
+        case 'i':
+            indexed = 1;
+            break;
+        default:
+            fprintf(stderr, "usage: %s [-ei] <port>\n", argv[0]);
+            exit(1);
+        }
+    }
+    if (optind != argc - 1) {
+	fprintf(stderr, "usage: %s [-ei] <port>\n", argv[0]);
 	exit(1);
     }
+    if (indexed)
+        printf("Indexed %d files\n", docindex_init("."));
 
-    listenfd = open_listenfd(argv[1]);
+    listenfd = open_listenfd(argv[optind]);
+    if (listenfd < 0) {
+        fprintf(stderr, "Tiny couldn't listen on port %s\n", argv[optind]);
+        exit(1);
+    }
+    if (evented)
+        event_loop(listenfd);                     /* never returns */
     while (1) {
 	clientlen = sizeof(clientaddr);
 	connfd = accept(listenfd, (SA *)&clientaddr, &clientlen); //line:netp:tiny:accept
         getnameinfo((SA *) &clientaddr, clientlen, hostname, MAXLINE, 
                     port, MAXLINE, 0);
         printf("Accepted connection from (%s, %s)\n", hostname, port);
-	doit(connfd);                                             //line:netp:tiny:doit
+	serve_conn(listenfd, connfd);                             //line:netp:tiny:doit
 	close(connfd);                                            //line:netp:tiny:close
     }
 }
 /* $end tinymain */
 
 /*
- * doit - handle one HTTP request/response transaction
+ * serve_conn - serve requests on one connection until the client, the
+ *     idle timeout or the per-connection request limit closes it
+ */
+void serve_conn(int listenfd, int fd)
+{
+    struct timeval tv = { KEEPALIVE_TIMEOUT, 0 };
+    struct pollfd fds[2];
+    rio_t rio;
+    int nreq = 0;
+
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    rio_readinitb(&rio, fd);
+    while (doit(fd, &rio, ++nreq < KEEPALIVE_MAX)) {
+        if (rio.rio_cnt > 0)    /* Next pipelined request already here */
+            continue;
+
+        /* An iterative server can only wait on one idle client, so give
+           up on this one as soon as another connection is queued */
+        fds[0].fd = fd;
+        fds[0].events = POLLIN;
+        fds[1].fd = listenfd;
+        fds[1].events = POLLIN;
+        if (poll(fds, 2, KEEPALIVE_TIMEOUT * 1000) <= 0 ||
+            !(fds[0].revents & (POLLIN | POLLHUP)))
+            break;
+    }
+}
+
+/*
+ * doit - handle one HTTP request/response transaction, returning 1 if
+ *     the connection should stay open for another request
  */
 /* $begin doit */
-void doit(int fd) 
+int doit(int fd, rio_t *rp, int may_keep) 
 {
-    int is_static;
+    int is_static, keep;
     struct stat sbuf;
+    docent_t *e;
     char buf[MAXLINE], method[MAXLINE], uri[MAXLINE], version[MAXLINE];
     char filename[MAXLINE], cgiargs[MAXLINE];
     char req_header_buf[MAXLINE];
-    rio_t rio;
 
     /* Read request line and headers */
-    rio_readinitb(&rio, fd);
-    if (!rio_readlineb(&rio, buf, MAXLINE))  //line:netp:doit:readrequest
-        return;
+    if (rio_readlineb(rp, buf, MAXLINE) <= 0)  //line:netp:doit:readrequest
+        return 0;
     printf("%s", buf);
-    sscanf(buf, "%s %s %s", method, uri, version);       //line:netp:doit:parserequest
+    if (sscanf(buf, "%s %s %s", method, uri, version) != 3) { //line:netp:doit:parserequest
+        clienterror(fd, 0, buf, "400", "Bad Request",
+                    "Tiny couldn't parse the request");
+        return 0;
+    }
     if (strcasecmp(method, "GET")) {                     //line:netp:doit:beginrequesterr
-        clienterror(fd, method, "501", "Not Implemented",
+        clienterror(fd, 0, method, "501", "Not Implemented",
                     "Tiny does not implement this method");
-        return;
+        return 0;
     }                                                    //line:netp:doit:endrequesterr
-    read_requesthdrs(&rio, req_header_buf);              //line:netp:doit:readrequesthdrs
+    if (!read_requesthdrs(rp, req_header_buf))           //line:netp:doit:readrequesthdrs
+        return 0;
+    keep = may_keep && request_keepalive(version, req_header_buf);
 
     /* Parse URI from GET request */
     is_static = parse_uri(uri, filename, cgiargs);       //line:netp:doit:staticcheck
+    if (is_static && (e = fresh_entry(filename, req_header_buf))) {
+        format_not_modified(buf, sizeof(buf), e, keep);
+        rio_writen(fd, buf, strlen(buf));
+        return keep;
+    }
     if (stat(filename, &sbuf) < 0) {                     //line:netp:doit:beginnotfound
-	clienterror(fd, filename, "404", "Not found",
+	clienterror(fd, keep, filename, "404", "Not found",
 		    "Tiny couldn't find this file");
-	return;
+	return keep;
     }                                                    //line:netp:doit:endnotfound
 
     if (is_static) { /* Serve static content */          
 	if (!(S_ISREG(sbuf.st_mode)) || !(S_IRUSR & sbuf.st_mode)) { //line:netp:doit:readable
-	    clienterror(fd, filename, "403", "Forbidden",
+	    clienterror(fd, keep, filename, "403", "Forbidden",
 			"Tiny couldn't read the file");
-	    return;
+	    return keep;
 	}
-	serve_static(fd, filename, sbuf.st_size);        //line:netp:doit:servestatic
+	serve_static(fd, filename, sbuf.st_size, keep,
+                     index_entry(filename, &sbuf));      //line:netp:doit:servestatic
+	return keep;
     }
     else { /* Serve dynamic content */
 	if (!(S_ISREG(sbuf.st_mode)) || !(S_IXUSR & sbuf.st_mode)) { //line:netp:doit:executable
-	    clienterror(fd, filename, "403", "Forbidden",
+	    clienterror(fd, keep, filename, "403", "Forbidden",
 			"Tiny couldn't run the CGI program");
-	    return;
+	    return keep;
 	}
+        /* Chunked framing needs HTTP/1.1; the repeater keeps running in
+           the background, so it always gets the connection to itself */
+        if (keep && !strcasecmp(version, "HTTP/1.1") &&
+            !strstr(filename, "repeater"))
+            return serve_dynamic_chunked(fd, filename, cgiargs,
+                                         req_header_buf);
 	serve_dynamic(fd, filename, cgiargs, req_header_buf);//line:netp:doit:servedynamic
+	return 0;
     }
 }
 /* $end doit */
 
 /*
- * read_requesthdrs - read HTTP request headers
+ * read_requesthdrs - read HTTP request headers, returning 0 if the
+ *     client went away (or timed out) before the blank line
  */
 /* $begin read_requesthdrs */
-void read_requesthdrs(rio_t *rp, char *req_header_buf) 
+int read_requesthdrs(rio_t *rp, char *req_header_buf) 
 {
-    char buf[MAXLINE];
-    req_header_buf[0]='\0';
+    char *line;
+    ssize_t n;
+    size_t len = 0;
 
-    rio_readlineb(rp, buf, MAXLINE);
-    printf("%s", buf);
-    strcat(req_header_buf, buf);
-    while(strcmp(buf, "\r\n")) {          //line:netp:readhdrs:checkterm
-        rio_readlineb(rp, buf, MAXLINE);
-        printf("%s", buf);
-        strcat(req_header_buf, buf);
-    }
-    return;
+    /* Lines are copied once, straight from the rio buffer */
+    do {                                  //line:netp:readhdrs:checkterm
+        if ((n = rio_peeklineb(rp, &line)) <= 0)
+            return 0;
+        printf("%.*s", (int)n, line);
+        if (len + n < MAXLINE) {
+            memcpy(req_header_buf + len, line, n);
+            len += n;
+        }
+    } while (n != 2 || memcmp(line, "\r\n", 2));
+    req_header_buf[len] = '\0';
+    return 1;
 }
 /* $end read_requesthdrs */
 
+/*
+ * request_keepalive - does the client want a persistent connection?
+ *     HTTP/1.1 defaults to yes, HTTP/1.0 to no; Connection overrides.
+ */
+int request_keepalive(char *version, char *headers)
+{
+    int keep = !strcasecmp(version, "HTTP/1.1");
+    char *p = headers;
+
+    while (p && *p) {
+        if (!strncasecmp(p, "Connection:", 11)) {
+            p += 11;
+            p += strspn(p, " \t");
+            if (!strncasecmp(p, "close", 5))
+                keep = 0;
+            else if (!strncasecmp(p, "keep-alive", 10))
+                keep = 1;
+        }
+        if ((p = strchr(p, '\n')) != NULL)
+            p++;
+    }
+    return keep;
+}
+
 /*
  * parse_uri - parse URI into filename and CGI args
  *             return 0 if dynamic content, 1 if static
@@ -155,37 +263,98 @@ int parse_uri(char *uri, char *filename, char *cgiargs)
 }
 /* $end parse_uri */
 
+/*
+ * fresh_entry - with the document index enabled, return the entry for
+ *     filename if the client's cached copy of it is still current
+ */
+docent_t *fresh_entry(char *filename, char *headers)
+{
+    docent_t *e;
+
+    docindex_refresh();
+    e = docindex_lookup(filename);
+    return e && docindex_fresh(e, headers) ? e : NULL;
+}
+
+/*
+ * index_entry - return the index entry for filename if it describes
+ *     the file stat just saw, so its validators can be sent
+ */
+docent_t *index_entry(char *filename, struct stat *sbuf)
+{
+    docent_t *e = docindex_lookup(filename);
+
+    return e && e->size == sbuf->st_size && e->mtime == sbuf->st_mtime ?
+        e : NULL;
+}
+
+/*
+ * format_static_header - build the response headers for a static file
+ *     into buf, returning their length. With an index entry the response
+ *     carries validators instead of forbidding caches to store it.
+ */
+int format_static_header(char *buf, size_t size, char *filetype,
+                         size_t filesize, int keep, docent_t *e)
+{
+    char cache[256];            /* Validator or no-store lines */
+    int n;
+
+    if (e)
+        format_validators(cache, sizeof(cache), e);
+    else
+        strcpy(cache, "Vary: *\r\n"
+               "Cache-Control: no-cache, no-store, must-revalidate\r\n");
+    n = snprintf(buf, size,
+                 "HTTP/1.1 200 OK\r\n"
+                 "Server: Tiny Web Server\r\n"
+                 "Connection: %s\r\n"
+                 "Content-length: %zu\r\n"
+                 "%s"
+                 "Content-type: %s\r\n\r\n",
+                 keep ? "keep-alive" : "close", filesize, cache, filetype);
+    return n < size ? n : size - 1;
+}
+
+/*
+ * format_not_modified - build a 304 response for an index entry
+ */
+int format_not_modified(char *buf, size_t size, docent_t *e, int keep)
+{
+    char cache[256];            /* Validator or no-store lines */
+    int n;
+
+    format_validators(cache, sizeof(cache), e);
+    n = snprintf(buf, size,
+                 "HTTP/1.1 304 Not Modified\r\n"
+                 "Server: Tiny Web Server\r\n"
+                 "Connection: %s\r\n"
+                 "%s\r\n",
+                 keep ? "keep-alive" : "close", cache);
+    return n < size ? n : size - 1;
+}
+
 /*
  * serve_static - copy a file back to the client 
  */
 /* $begin serve_static */
-void serve_static(int fd, char *filename, int filesize) 
+void serve_static(int fd, char *filename, int filesize, int keep,
+                  docent_t *e) 
 {
     int srcfd;
-    char *srcp, filetype[MAXLINE], buf[MAXBUF];
+    char filetype[MAXLINE], buf[MAXBUF];
  
     /* Send response headers to client */
     get_filetype(filename, filetype);       //line:netp:servestatic:getfiletype
-#pragma GCC diagnostic push
-#pragma GCC diagnostic ignored "-Wformat-overflow"
-    sprintf(buf, "HTTP/1.0 200 OK\r\n");    //line:netp:servestatic:beginserve
-    sprintf(buf, "%sServer: Tiny Web Server\r\n", buf);
-    sprintf(buf, "%sConnection: close\r\n", buf);
-    sprintf(buf, "%sContent-length: %d\r\n", buf, filesize);
-    sprintf(buf, "%sVary: *\r\n", buf);
-    sprintf(buf, "%sCache-Control: no-cache, no-store, must-revalidate\r\n", buf);
-    sprintf(buf, "%sContent-type: %s\r\n\r\n", buf, filetype);
-#pragma GCC diagnostic pop
+    format_static_header(buf, sizeof(buf), filetype, filesize, keep, e); //line:netp:servestatic:beginserve
     rio_writen(fd, buf, strlen(buf));       //line:netp:servestatic:endserve
     printf("Response headers:\n");
     printf("%s", buf);
 
-    /* Send response body to client */
-    srcfd = open(filename, O_RDONLY, 0);    //line:netp:servestatic:open
-    srcp = mmap(0, filesize, PROT_READ, MAP_PRIVATE, srcfd, 0);//line:netp:servestatic:mmap
+    /* Send response body to client, in the kernel where possible */
+    if ((srcfd = open(filename, O_RDONLY, 0)) < 0) //line:netp:servestatic:open
+        return;
+    rio_copy(srcfd, fd);                    //line:netp:servestatic:write
     close(srcfd);                           //line:netp:servestatic:close
-    rio_writen(fd, srcp, filesize);         //line:netp:servestatic:write
-    munmap(srcp, filesize);                 //line:netp:servestatic:munmap
 }
 
 /*
@@ -250,13 +419,144 @@ void serve_dynamic(int fd, char *filename, char *cgiargs, char *headers)
 /* $end serve_dynamic */
 
 /*
- * clienterror - returns an error message to the client
+ * format_cgi_header - build the response headers for CGI output into
+ *     buf, returning their length. cgihdrs holds the CGI program's own
+ *     header lines; its framing headers are replaced by ours.
+ */
+int format_cgi_header(char *buf, size_t size, char *cgihdrs,
+                      int chunked, int keep)
+{
+    char *line, *next;
+    size_t n, len;
+
+    n = snprintf(buf, size,
+                 "HTTP/1.1 200 OK\r\n"
+                 "Server: Tiny Web Server\r\n"
+                 "Connection: %s\r\n"
+                 "%s"
+                 "Vary: *\r\n"
+                 "Cache-Control: no-cache, no-store, must-revalidate\r\n",
+                 keep ? "keep-alive" : "close",
+                 chunked ? "Transfer-Encoding: chunked\r\n" : "");
+    for (line = cgihdrs; *line && n < size; line = next) {
+        next = strchr(line, '\n');
+        next = next ? next + 1 : line + strlen(line);
+        len = next - line;
+        if (!strncasecmp(line, "Connection:", 11) ||
+            (chunked && !strncasecmp(line, "Content-length:", 15)))
+            continue;
+        if (n + len + 2 >= size)
+            break;
+        memcpy(buf + n, line, len);
+        n += len;
+    }
+    n += snprintf(buf + n, size - n, "\r\n");
+    return n < size ? n : size - 1;
+}
+
+/*
+ * write_chunk - send one chunk of a chunked response body
+ */
+static int write_chunk(int fd, char *data, size_t n)
+{
+    char hdr[32];
+    struct iovec iov[3];
+
+    iov[0].iov_base = hdr;
+    iov[0].iov_len = sprintf(hdr, "%zx\r\n", n);
+    iov[1].iov_base = data;
+    iov[1].iov_len = n;
+    iov[2].iov_base = "\r\n";
+    iov[2].iov_len = 2;
+    return rio_writev(fd, iov, 3) >= 0;
+}
+
+/*
+ * serve_dynamic_chunked - run a CGI program with its output on a pipe
+ *     and relay it as a chunked HTTP/1.1 response, so the connection
+ *     can be reused afterwards. Returns 1 if it can.
+ */
+int serve_dynamic_chunked(int fd, char *filename, char *cgiargs,
+                          char *headers)
+{
+    char buf[MAXBUF], hdr[2 * MAXBUF], *body, *emptylist[] = { NULL };
+    int pfd[2], ok = 1;
+    size_t len = 0;
+    ssize_t n;
+    pid_t pid;
+
+    if (pipe(pfd) < 0) {
+        clienterror(fd, 0, filename, "500", "Internal Server Error",
+                    "Tiny couldn't start the CGI program");
+        return 0;
+    }
+    if ((pid = fork()) < 0) {
+        close(pfd[0]);
+        close(pfd[1]);
+        clienterror(fd, 0, filename, "500", "Internal Server Error",
+                    "Tiny couldn't fork the CGI process");
+        return 0;
+    }
+    if (pid == 0) { /* Child */
+        close(pfd[0]);
+        setenv("QUERY_STRING", cgiargs, 1);
+        setenv("REQUEST_HEADERS", headers, 1);
+        dup2(pfd[1], STDOUT_FILENO);
+        execve(filename, emptylist, environ);
+        exit(1);
+    }
+    close(pfd[1]);
+
+    /* Collect the CGI program's headers */
+    body = NULL;
+    while (len < sizeof(buf) - 1 &&
+           (n = read(pfd[0], buf + len, sizeof(buf) - 1 - len)) > 0) {
+        len += n;
+        buf[len] = '\0';
+        if ((body = strstr(buf, "\r\n\r\n")) != NULL)
+            break;
+    }
+    if (body == NULL) {
+        clienterror(fd, 0, filename, "502", "Bad Gateway",
+                    "The CGI program sent no headers");
+        ok = 0;
+        goto done;
+    }
+    body[2] = '\0';
+    body += 4;
+    n = format_cgi_header(hdr, sizeof(hdr), buf, 1, 1);
+    if (rio_writen(fd, hdr, n) != n) {
+        ok = 0;
+        goto done;
+    }
+
+    /* Relay the body as it arrives */
+    n = buf + len - body;
+    do {
+        if (n > 0 && !write_chunk(fd, body, n)) {
+            ok = 0;
+            goto done;
+        }
+        body = buf;
+    } while ((n = read(pfd[0], buf, sizeof(buf))) > 0);
+    ok = rio_writen(fd, "0\r\n\r\n", 5) == 5;
+
+ done:
+    close(pfd[0]);
+    waitpid(pid, NULL, 0);
+    return ok;
+}
+
+/*
+ * format_error - build a complete error response (headers and body)
+ *     into buf, returning its length
  */
 /* $begin clienterror */
-void clienterror(int fd, char *cause, char *errnum, 
-		 char *shortmsg, char *longmsg) 
+int format_error(char *buf, size_t size, int keep, char *cause,
+                 char *errnum, char *shortmsg, char *longmsg)
 {
-    char buf[MAXLINE], body[MAXBUF];
+    char body[MAXBUF];
+    int n;
 
 #pragma GCC diagnostic push
 #pragma GCC diagnostic ignored "-Wformat-overflow"
@@ -269,12 +569,25 @@ void clienterror(int fd, char *cause, char *errnum,
 #pragma GCC diagnostic pop
 
     /* Print the HTTP response */
-    sprintf(buf, "HTTP/1.0 %s %s\r\n", errnum, shortmsg);
-    rio_writen(fd, buf, strlen(buf));
-    sprintf(buf, "Content-type: text/html\r\n");
-    rio_writen(fd, buf, strlen(buf));
-    sprintf(buf, "Content-length: %d\r\n\r\n", (int)strlen(body));
-    rio_writen(fd, buf, strlen(buf));
-    rio_writen(fd, body, strlen(body));
+    n = snprintf(buf, size, "HTTP/1.1 %s %s\r\n"
+                 "Connection: %s\r\n"
+                 "Content-type: text/html\r\n"
+                 "Content-length: %d\r\n\r\n%s",
+                 errnum, shortmsg, keep ? "keep-alive" : "close",
+                 (int)strlen(body), body);
+    return n < size ? n : size - 1;
+}
+
+/*
+ * clienterror - returns an error message to the client
+ */
+void clienterror(int fd, int keep, char *cause, char *errnum, 
+		 char *shortmsg, char *longmsg) 
+{
+    char buf[2 * MAXBUF];
+    int n = format_error(buf, sizeof(buf), keep, cause, errnum,
+                         shortmsg, longmsg);
+
+    rio_writen(fd, buf, n);
 }
 /* $end clienterror */
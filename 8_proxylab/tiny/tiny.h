@@ -0,0 +1,33 @@
+/*
+ * tiny.h - Routines shared by the iterative and event-driven Tiny servers
+ */
+#ifndef __TINY_H__
+#define __TINY_H__
+
+#include "csapp.h"
+#include "docindex.h"
+
+/* Persistent connection policy */
+#define KEEPALIVE_MAX     100   /* Requests served per connection */
+#define KEEPALIVE_TIMEOUT 5     /* Seconds an idle connection is kept */
+
+int parse_uri(char *uri, char *filename, char *cgiargs);
+int request_keepalive(char *version, char *headers);
+void get_filetype(char *filename, char *filetype);
+void serve_dynamic(int fd, char *filename, char *cgiargs, char *headers);
+void clienterror(int fd, int keep, char *cause, char *errnum,
+                 char *shortmsg, char *longmsg);
+int format_error(char *buf, size_t size, int keep, char *cause,
+                 char *errnum, char *shortmsg, char *longmsg);
+int format_static_header(char *buf, size_t size, char *filetype,
+                         size_t filesize, int keep, docent_t *e);
+int format_not_modified(char *buf, size_t size, docent_t *e, int keep);
+docent_t *fresh_entry(char *filename, char *headers);
+docent_t *index_entry(char *filename, struct stat *sbuf);
+int format_cgi_header(char *buf, size_t size, char *cgihdrs,
+                      int chunked, int keep);
+
+/* Event-driven server (evloop.c) */
+void event_loop(int listenfd);
+
+#endif /* __TINY_H__ */